@@ -0,0 +1,342 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Throughput of the receive path: a corpus of Roboteq replies is replayed as fast
+ * as possible through the line framer, through the async reader of
+ * serial_controller with the dispatch of the callbacks, and through
+ * Motor::readVector. The corpus is the RX side of capture files or, without
+ * arguments, a synthetic telemetry stream of a two channels board.
+ * The readVector stage needs a ROS master, it is skipped without.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ros/ros.h>
+
+#include "roboteq/serial_controller.h"
+#include "roboteq/session_capture.h"
+#include "roboteq/telemetry.h"
+#include "roboteq/motor.h"
+
+using namespace roboteq;
+
+typedef std::chrono::steady_clock clock_type;
+
+// Allocations of all threads
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+const size_t channels = 2;
+const size_t synthetic_frames = 200000;
+
+/**
+ * @brief The corpus_t class Replies received and statistics of the lines
+ */
+typedef struct _corpus {
+    std::string data;
+    // Lines "NAME=DATA" and "+" / "-"
+    uint64_t queries;
+    uint64_t acks;
+    // Telemetry replies and values for all channels
+    uint64_t telemetry;
+    uint64_t fields;
+} corpus_t;
+
+/**
+ * @brief telemetry_index The telemetry field of a query
+ * @return The field, TELEMETRY_FIELDS if not a telemetry query
+ */
+static size_t telemetry_index(const boost::string_ref &name)
+{
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        if(name == telemetry_query[n][0])
+            return n;
+    return TELEMETRY_FIELDS;
+}
+
+/**
+ * @brief add_lines Keep the replies of the board, the echo and other lines are dropped
+ */
+static void add_lines(corpus_t &corpus, const boost::string_ref &data)
+{
+    line_framer framer;
+    boost::string_ref line, name, value;
+    size_t offset = 0;
+    while(offset < data.size())
+    {
+        size_t size;
+        char* buffer = framer.prepare(size);
+        size = std::min(size, data.size() - offset);
+        std::copy(data.data() + offset, data.data() + offset + size, buffer);
+        framer.commit(size);
+        offset += size;
+        while(framer.next(line))
+        {
+            line_type_t type = scan_line(line, name, value);
+            if(type == LINE_QUERY)
+            {
+                corpus.queries++;
+                if(telemetry_index(name) < TELEMETRY_FIELDS)
+                {
+                    corpus.telemetry++;
+                    corpus.fields += (name == "V") ? 1 : std::count(value.begin(), value.end(), ':') + 1;
+                }
+            }
+            else if(type == LINE_ACK || type == LINE_NACK)
+            {
+                corpus.acks++;
+            }
+            else
+            {
+                continue;
+            }
+            corpus.data.append(line.data(), line.size());
+            corpus.data += '\r';
+        }
+    }
+}
+
+static void synthetic(corpus_t &corpus)
+{
+    std::string data;
+    char line[64];
+    for(size_t k = 0; k < synthetic_frames; ++k)
+    {
+        int v = static_cast<int>(k % 2000) - 1000;
+        data += "+\r+\r";
+        for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        {
+            if(n == FIELD_VOLTS)
+                snprintf(line, sizeof(line), "V=%d\r", 240 + v % 7);
+            else if(n == FIELD_COUNTER)
+                snprintf(line, sizeof(line), "C=%d:%d\r", (int) k * 37, -(int) k * 41);
+            else
+                snprintf(line, sizeof(line), "%s=%d:%d\r", telemetry_query[n][0], v, -v);
+            data += line;
+        }
+    }
+    add_lines(corpus, data);
+}
+
+static bool load(corpus_t &corpus, const char* path)
+{
+    capture_reader reader;
+    if(!reader.open(path))
+    {
+        fprintf(stderr, "%s\n", reader.error().c_str());
+        return false;
+    }
+    std::string rx;
+    capture_record_t record;
+    boost::string_ref payload;
+    while(reader.next(record, payload))
+    {
+        if(record.direction == CAPTURE_RX)
+            rx.append(payload.data(), payload.size());
+    }
+    add_lines(corpus, rx);
+    return true;
+}
+
+static void report(const char* stage, double seconds, uint64_t lines, uint64_t fields, uint64_t allocs)
+{
+    printf("%-10s %12.0f lines/s %8.1f ns/line %8.1f ns/field %8.3f allocs/line\n", stage,
+           lines / seconds, seconds * 1e9 / std::max<uint64_t>(lines, 1),
+           seconds * 1e9 / std::max<uint64_t>(fields, 1),
+           static_cast<double>(allocs) / std::max<uint64_t>(lines, 1));
+}
+
+volatile int sink;
+
+/**
+ * @brief bench_framer Split in lines and scan the replies, without threads and system calls
+ */
+static void bench_framer(const corpus_t &corpus)
+{
+    line_framer framer;
+    boost::string_ref line, name, value;
+    uint64_t allocs = allocations;
+    clock_type::time_point start = clock_type::now();
+    size_t offset = 0;
+    uint64_t lines = 0;
+    while(offset < corpus.data.size())
+    {
+        size_t size;
+        char* buffer = framer.prepare(size);
+        size = std::min(size, corpus.data.size() - offset);
+        memcpy(buffer, corpus.data.data() + offset, size);
+        framer.commit(size);
+        offset += size;
+        while(framer.next(line))
+        {
+            sink = scan_line(line, name, value);
+            lines++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    report("framer", seconds, lines, corpus.fields, allocations - allocs);
+}
+
+/**
+ * @brief The dispatch_sink class Decode the telemetry dispatched from the reader
+ */
+class dispatch_sink
+{
+public:
+    dispatch_sink() : lines(0)
+    {
+        clear_frames(frames, channels);
+    }
+    void onData(const boost::string_ref data, size_t field)
+    {
+        decode_field((telemetry_field_t) field, data, frames, channels);
+        lines.fetch_add(1, std::memory_order_release);
+    }
+    motor_frame_t frames[channels];
+    std::atomic<uint64_t> lines;
+};
+
+/**
+ * @brief bench_dispatch All lines through the async reader of serial_controller on a loopback
+ */
+static void bench_dispatch(const corpus_t &corpus)
+{
+    loopback_transport* link = new loopback_transport();
+    if(!link->open())
+    {
+        fprintf(stderr, "Loopback: %s\n", link->error().c_str());
+        delete link;
+        return;
+    }
+    std::unique_ptr<fd_transport> board(link->takePeer());
+    serial_controller serial(link, 115200);
+    dispatch_sink sink;
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+    {
+        serial.addCallback(std::bind(&dispatch_sink::onData, &sink, std::placeholders::_1, n), telemetry_query[n][0]);
+    }
+    if(!serial.start())
+        return;
+    uint64_t allocs = allocations;
+    clock_type::time_point start = clock_type::now();
+    std::thread writer([&board, &corpus]{ board->write(corpus.data.data(), corpus.data.size()); });
+    clock_type::time_point timeout = start + std::chrono::seconds(60);
+    while(sink.lines.load(std::memory_order_acquire) < corpus.telemetry && clock_type::now() < timeout)
+    {
+        std::this_thread::yield();
+    }
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    uint64_t used = allocations - allocs;
+    writer.join();
+    report("dispatch", seconds, corpus.queries + corpus.acks, corpus.fields, used);
+    if(sink.lines < corpus.telemetry)
+        fprintf(stderr, "dispatch: %lu of %lu lines received\n", (unsigned long) sink.lines, (unsigned long) corpus.telemetry);
+    // The board does not reply to the stop
+    serial.setRetryBudget(PRIORITY_CONFIG, 1);
+    serial.stop();
+}
+
+/**
+ * @brief bench_motor Conversion of the decoded frames in Motor::readVector
+ */
+static void bench_motor(const corpus_t &corpus, int argc, char **argv)
+{
+    ros::init(argc, argv, "roboteq_control_bench", ros::init_options::AnonymousName | ros::init_options::NoSigintHandler);
+    if(!ros::master::check())
+    {
+        printf("%-10s skipped, no ROS master\n", "readVector");
+        return;
+    }
+    ros::NodeHandle nh("~");
+    // The motor does not talk with the board in readVector
+    serial_controller serial(new loopback_transport(), 115200);
+    std::vector<Motor*> motors;
+    for(size_t i = 0; i < channels; ++i)
+        motors.push_back(new Motor(nh, &serial, "bench_motor" + std::to_string(i + 1), i + 1));
+    // A frame for each telemetry frame of the corpus
+    motor_frame_t frames[channels];
+    clear_frames(frames, channels);
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        decode_field((telemetry_field_t) n, boost::string_ref(n == FIELD_VOLTS ? "240" : "-250:250"), frames, channels);
+    uint64_t count = std::max<uint64_t>(corpus.telemetry / TELEMETRY_FIELDS, 1);
+    uint64_t allocs = allocations;
+    clock_type::time_point start = clock_type::now();
+    for(uint64_t k = 0; k < count; ++k)
+        for(size_t i = 0; i < channels; ++i)
+            motors[i]->readVector(frames[i]);
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    report("readVector", seconds, count * TELEMETRY_FIELDS, count * TELEMETRY_FIELDS * channels, allocations - allocs);
+    for(size_t i = 0; i < motors.size(); ++i)
+        delete motors[i];
+}
+
+int main(int argc, char **argv)
+{
+    corpus_t corpus = corpus_t();
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!load(corpus, argv[i]))
+            return 1;
+    }
+    if(argc < 2)
+        synthetic(corpus);
+    printf("corpus     %lu bytes, %lu replies, %lu acks, %lu telemetry values\n",
+           (unsigned long) corpus.data.size(), (unsigned long) corpus.queries,
+           (unsigned long) corpus.acks, (unsigned long) corpus.fields);
+    if(corpus.queries + corpus.acks == 0)
+        return 1;
+    bench_framer(corpus);
+    bench_dispatch(corpus);
+    bench_motor(corpus, argc, argv);
+    return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Decode time of a telemetry frame: the old path with boost::split and
+ * boost::lexical_cast against the frame decoded with decode_field.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "roboteq/telemetry.h"
+
+using namespace roboteq;
+
+// Replies of a two channels board, in the order of the telemetry queries
+const char* const replies[TELEMETRY_FIELDS] = {
+    "0:0", "-250:250", "-248:251", "-2:-1", "-312:315", "243", "-53:57", "-12:13", "-1563482:1560017", "1:1"
+};
+
+const size_t channels = 2;
+const size_t iterations = 200000;
+
+volatile double sink;
+
+// Decode with split and lexical cast, as in Roboteq::read and Motor::readVector before
+double legacy(const std::vector<std::string> &frame)
+{
+    std::vector<std::string> motors[channels];
+    std::vector<std::string> fields;
+    for(size_t n = 0; n < frame.size(); ++n)
+    {
+        if(n == FIELD_VOLTS)
+            fields.assign(channels, frame[n]);
+        else
+            boost::split(fields, frame[n], boost::algorithm::is_any_of(":"));
+        for(size_t i = 0; i < fields.size() && i < channels; ++i)
+            motors[i].push_back(fields[i]);
+    }
+    double sum = 0;
+    for(size_t i = 0; i < channels; ++i)
+    {
+        sum += boost::lexical_cast<unsigned int>(motors[i][0]);
+        for(size_t n = 1; n < TELEMETRY_FIELDS - 1; ++n)
+            sum += boost::lexical_cast<double>(motors[i][n]);
+        sum += boost::lexical_cast<long>(motors[i][TELEMETRY_FIELDS - 1]);
+    }
+    return sum;
+}
+
+// Decode directly in the frames
+double typed(const std::vector<std::string> &frame)
+{
+    motor_frame_t frames[channels];
+    clear_frames(frames, channels);
+    for(size_t n = 0; n < frame.size(); ++n)
+        decode_field((telemetry_field_t) n, boost::string_ref(frame[n]), frames, channels);
+    double sum = 0;
+    for(size_t i = 0; i < channels; ++i)
+        for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+            sum += frames[i].value[n];
+    return sum;
+}
+
+template<typename F>
+double measure(const char* name, F decode, const std::vector<std::string> &frame)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < iterations; ++i)
+        sink = decode(frame);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    double ns = elapsed.count() / iterations;
+    printf("%-8s %10.1f ns/frame  (%.1f ns/field)\n", name, ns, ns / (TELEMETRY_FIELDS * channels));
+    return ns;
+}
+
+int main()
+{
+    std::vector<std::string> frame(replies, replies + TELEMETRY_FIELDS);
+    if(legacy(frame) != typed(frame))
+    {
+        printf("Decoders mismatch\n");
+        return 1;
+    }
+    double before = measure("before", legacy, frame);
+    double after = measure("after", typed, frame);
+    printf("speedup  %10.1fx\n", before / after);
+    return 0;
+}
@@ -0,0 +1,330 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Soak benchmark of the serial path of the driver against the board emulator.
+ * For each fault profile the emulator is started on a pseudo terminal and the
+ * control cycle of the driver runs at a fixed rate: the command line formatted
+ * with format_commands and the telemetry selected from the polling plan with
+ * the default rates of the driver. The report has the control rate achieved,
+ * the tail latency of the cycle and the time to recover after the faults.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <ros/ros.h>
+
+#include "roboteq/serial_controller.h"
+#include "roboteq/control_cycle.h"
+#include "roboteq/polling_planner.h"
+#include "roboteq/trace_recorder.h"
+
+using namespace roboteq;
+
+typedef std::chrono::steady_clock clock_type;
+
+// Channels of the board emulated
+const size_t channels = 2;
+// Max speed of the motors in RPM, the commands are in per mille of this speed
+const double max_rpm = 3000.0;
+
+typedef struct _soak_result {
+    double duration;
+    uint64_t cycles;
+    uint64_t failures;
+    // Latency of the cycles completed in us
+    std::vector<uint32_t> latency;
+    // Time from the first cycle failed to the next completed in ms
+    std::vector<double> recovery;
+    // Lowest and last timeout of the link estimator in ms
+    double rto_min;
+    double rto_last;
+} soak_result_t;
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+                    "  --emulator path   Emulator executable, default roboteq_emulator near this benchmark\n"
+                    "  --profiles list   Profiles separated with commas, default clean,noisy,laggy,flaky,field\n"
+                    "  --duration s      Duration of each profile, default 60\n"
+                    "  --rate hz         Control rate, default 100\n"
+                    "  --baud N          Baud rate, default 115200\n"
+                    "  --trace prefix    Save the timeline of each profile in <prefix><profile>.json\n", name);
+}
+
+/**
+ * @brief spawn Start the emulator and wait the pseudo terminal
+ * @param emulator The executable
+ * @param args The arguments
+ * @param pid The process started
+ * @return The pipe of the standard output, -1 on error
+ */
+static int spawn(const std::string &emulator, const std::vector<std::string> &args, pid_t &pid)
+{
+    int fd[2];
+    if(pipe(fd) < 0)
+        return -1;
+    pid = fork();
+    if(pid == 0)
+    {
+        dup2(fd[1], STDOUT_FILENO);
+        ::close(fd[0]);
+        ::close(fd[1]);
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(emulator.c_str()));
+        for(size_t i = 0; i < args.size(); ++i)
+            argv.push_back(const_cast<char*>(args[i].c_str()));
+        argv.push_back(NULL);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    ::close(fd[1]);
+    // The first line is the slave side, the pipe stay open for the next ones
+    char c;
+    while(read(fd[0], &c, 1) == 1 && c != '\n') {}
+    return fd[0];
+}
+
+/**
+ * @brief percentile The percentile of the sorted samples
+ */
+static double percentile(const std::vector<uint32_t> &sorted, double p)
+{
+    if(sorted.empty())
+        return 0;
+    size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[idx];
+}
+
+static void soak(const std::string &port, unsigned long baud, double rate, double duration, soak_result_t &result)
+{
+    serial_controller serial(port, baud);
+    result.cycles = result.failures = 0;
+    result.duration = duration;
+    result.rto_min = result.rto_last = 0;
+    if(!serial.start())
+        return;
+    // Echo disabled as in the driver
+    serial.echo(false);
+    // Polling plan of the driver with the default rates, as Roboteq::setupPollingPlan
+    polling_planner planner;
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        planner.add(telemetry_query[n][0], telemetry_query[n][1], telemetry_plan[n].rate, telemetry_plan[n].reply_size);
+    for(size_t n = 0; n < BOARD_FIELDS; ++n)
+        planner.add(board_query[n][0], board_query[n][1], board_plan[n].rate, board_plan[n].reply_size);
+    planner.setBudget(static_cast<size_t>(polling_line(baud, rate) * polling_utilization));
+    vector<size_t> batch;
+    vector<query_t> queries;
+    vector<request_ptr> commands, replies;
+    command_mailbox_t mailbox = command_mailbox_t();
+    tx_buffer line;
+
+    clock_type::duration period = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / rate));
+    clock_type::time_point start = clock_type::now();
+    clock_type::time_point end = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(duration));
+    clock_type::time_point next = start;
+    clock_type::time_point outage;
+    bool failing = false;
+    while(clock_type::now() < end)
+    {
+        clock_type::time_point cycle = clock_type::now();
+        // Acknowledgements of the previous commands, without wait
+        bool status = true;
+        for(size_t i = 0; i < commands.size(); ++i)
+            status &= !serial.poll(commands[i]) || commands[i]->status;
+        // Sine wave on the motors at half speed in closed loop speed, as Roboteq::sendCommands
+        double t = std::chrono::duration<double>(cycle - start).count();
+        double rpm = 0.5 * max_rpm * std::sin(t);
+        for(size_t idx = 0; idx < channels; ++idx)
+        {
+            mailbox.mode[idx] = 1;
+            mailbox.command[idx] = velocity_command((idx % 2) ? -rpm : rpm, max_rpm);
+        }
+        mailbox.valid = (1u << channels) - 1;
+        line.clear();
+        format_commands(mailbox, channels, true, line);
+        line.finish();
+        serial.asyncCommands(line, commands);
+        // Fields due in this cycle, as Roboteq::pollTelemetry
+        planner.plan(monotonic_ns(), batch);
+        queries.resize(batch.size());
+        for(size_t n = 0; n < batch.size(); ++n)
+        {
+            queries[n].first = planner.entry(batch[n]).name;
+            queries[n].second = planner.entry(batch[n]).params;
+        }
+        status &= serial.batchQuery(queries, replies);
+        uint64_t stamp = monotonic_ns();
+        for(size_t n = 0; n < replies.size(); ++n)
+        {
+            if(replies[n]->received)
+                planner.update(batch[n], stamp);
+        }
+        clock_type::time_point done = clock_type::now();
+        // The timeout of the link must not collapse under the late replies
+        result.rto_last = serial.getLinkStats().rto / 1000.0;
+        result.rto_min = (result.cycles == 0) ? result.rto_last : std::min(result.rto_min, result.rto_last);
+        result.cycles++;
+        if(status)
+        {
+            result.latency.push_back(std::chrono::duration_cast<std::chrono::microseconds>(done - cycle).count());
+            if(failing)
+                result.recovery.push_back(std::chrono::duration<double, std::milli>(done - outage).count());
+            failing = false;
+        }
+        else
+        {
+            result.failures++;
+            if(!failing)
+                outage = cycle;
+            failing = true;
+        }
+        // Fixed rate, the cycles late are not recovered
+        next += period;
+        if(next < done)
+            next = done;
+        std::this_thread::sleep_until(next);
+    }
+    result.duration = std::chrono::duration<double>(clock_type::now() - start).count();
+    serial.stop();
+}
+
+static void report(const std::string &profile, soak_result_t &result)
+{
+    std::sort(result.latency.begin(), result.latency.end());
+    double mean = 0, worst = 0;
+    for(size_t i = 0; i < result.recovery.size(); ++i)
+    {
+        mean += result.recovery[i];
+        worst = std::max(worst, result.recovery[i]);
+    }
+    if(!result.recovery.empty())
+        mean /= result.recovery.size();
+    printf("%-8s %9.1f Hz %8lu/%-8lu %8.2f %8.2f %8.2f %8.2f ms %5lu %8.1f %8.1f ms %8.2f %8.2f ms\n",
+           profile.c_str(),
+           result.latency.size() / std::max(result.duration, 1e-9),
+           (unsigned long) result.failures, (unsigned long) result.cycles,
+           percentile(result.latency, 0.50) / 1000.0, percentile(result.latency, 0.99) / 1000.0,
+           percentile(result.latency, 0.999) / 1000.0, (result.latency.empty() ? 0 : result.latency.back() / 1000.0),
+           (unsigned long) result.recovery.size(), mean, worst, result.rto_min, result.rto_last);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    std::string emulator;
+    std::string profiles("clean,noisy,laggy,flaky,field");
+    double duration = 60;
+    double rate = 100;
+    unsigned long baud = 115200;
+    std::string trace;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if(i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        if(arg == "--emulator") emulator = value;
+        else if(arg == "--profiles") profiles = value;
+        else if(arg == "--duration") duration = atof(value);
+        else if(arg == "--rate") rate = atof(value);
+        else if(arg == "--baud") baud = strtoul(value, NULL, 10);
+        else if(arg == "--trace") trace = value;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(emulator.empty())
+    {
+        // Installed in the same folder
+        std::string self(argv[0]);
+        size_t slash = self.rfind('/');
+        emulator = (slash == std::string::npos) ? "roboteq_emulator" : self.substr(0, slash + 1) + "roboteq_emulator";
+    }
+    ros::Time::init();
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string link = "/tmp/roboteq_soak_" + std::to_string(getpid());
+    printf("%-8s %12s %17s %8s %8s %8s %11s %5s %8s %11s %8s %11s\n",
+           "profile", "rate", "failed/cycles", "p50", "p99", "p99.9", "max", "outs", "recovery", "worst", "rto min", "rto last");
+    size_t start = 0;
+    while(start <= profiles.size())
+    {
+        size_t comma = profiles.find(',', start);
+        if(comma == std::string::npos)
+            comma = profiles.size();
+        std::string profile = profiles.substr(start, comma - start);
+        start = comma + 1;
+        if(profile.empty())
+            continue;
+        std::vector<std::string> args;
+        args.push_back("--profile"); args.push_back(profile);
+        args.push_back("--baud"); args.push_back(std::to_string(baud));
+        args.push_back("--link"); args.push_back(link);
+        pid_t pid;
+        int out = spawn(emulator, args, pid);
+        if(out < 0 || pid < 0)
+        {
+            fprintf(stderr, "Unable to start %s\n", emulator.c_str());
+            return 1;
+        }
+        soak_result_t result;
+        if(!trace.empty())
+            trace_recorder::instance().start(1 << 18);
+        soak(link, baud, rate, duration, result);
+        if(!trace.empty())
+        {
+            trace_recorder::instance().stop();
+            if(trace_recorder::instance().save(trace + profile + ".json") < 0)
+                fprintf(stderr, "Unable to save the timeline in %s%s.json\n", trace.c_str(), profile.c_str());
+        }
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        ::close(out);
+        report(profile, result);
+    }
+    return 0;
+}
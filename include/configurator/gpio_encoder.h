@@ -32,6 +32,7 @@
 #define GPIOENCODERCONFIGURATOR_H
 
 #include <ros/ros.h>
+#include <atomic>
 
 #include <roboteq_control/RoboteqEncoderConfig.h>
 #include <dynamic_reconfigure/server.h>
@@ -78,7 +79,9 @@ private:
     std::vector<roboteq::Motor *> _motor;
 
     // reduction value
-    double _reduction;
+    std::atomic<double> _reduction;
+    // Encoder position respect to the gears, 1 before
+    std::atomic<int> _position;
 
     /// Dynamic reconfigure encoder
     dynamic_reconfigure::Server<roboteq_control::RoboteqEncoderConfig> *ds_encoder;
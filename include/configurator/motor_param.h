@@ -32,6 +32,7 @@
 #define GPIOPARAMCONFIGURATOR_H
 
 #include <ros/ros.h>
+#include <atomic>
 
 #include <roboteq_control/RoboteqParameterConfig.h>
 #include <roboteq_control/RoboteqEncoderConfig.h>
@@ -70,8 +71,26 @@ public:
      * 6 - closed_loop_speed_position
      */
     void setOperativeMode(int type);
+    /**
+     * @brief getRatio Gear ratio, cached and updated from the dynamic reconfigure
+     * @return The gear ratio
+     */
+    double getRatio() const
+    {
+        return _ratio.load();
+    }
+    /**
+     * @brief getMaxSpeed Max motor speed after gear reduction, cached and updated from the dynamic reconfigure
+     * @return The max speed in RPM
+     */
+    double getMaxSpeed() const
+    {
+        return _max_speed.load();
+    }
 
 private:
+    /// Parameters used in the control loop
+    std::atomic<double> _ratio, _max_speed;
     /// Setup variable
     bool setup_param, setup_pid_type;
 
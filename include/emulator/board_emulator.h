@@ -0,0 +1,162 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BOARD_EMULATOR_H
+#define BOARD_EMULATOR_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <boost/utility/string_ref.hpp>
+
+namespace emulator {
+
+/// Maximum number of channels emulated
+const size_t max_channels = 3;
+
+/// State of an emulated motor
+typedef struct _motor_model {
+    // Command received [-1000, 1000]
+    int32_t command;
+    // Speed of the motor in RPM
+    double speed;
+    // Encoder counter
+    double counter;
+} motor_model_t;
+
+/**
+ * @brief The board_emulator class Subset of the Roboteq ASCII protocol used from the driver.
+ * Queries "?", commands "!", set "^" and get "~" of parameters, maintenance "%" and the
+ * repeat of the history buffer "#". Each channel drive a first order motor model
+ */
+class board_emulator
+{
+public:
+    typedef std::chrono::steady_clock clock_t;
+    /**
+     * @brief board_emulator Initialize the board
+     * @param channels The number of channels
+     */
+    explicit board_emulator(size_t channels = 2);
+    /**
+     * @brief process Execute a line received, the commands are separated with "_"
+     * @param line The line without the end of line
+     * @param out The replies are appended
+     */
+    void process(const boost::string_ref &line, std::string &out);
+    /**
+     * @brief repeat Execute the history buffer if the repeat period is elapsed
+     * @param out The replies are appended
+     * @return Milliseconds before the next repeat, negative if the repeat is stopped
+     */
+    int repeat(std::string &out);
+    /**
+     * @brief motor The state of a motor
+     * @param channel The channel from zero
+     * @return The state
+     */
+    const motor_model_t &motor(size_t channel) const
+    {
+        return mMotor[channel];
+    }
+
+private:
+    // Number of channels
+    size_t mChannels;
+    // Motors
+    motor_model_t mMotor[max_channels];
+    // Parameters, index 0 for the board and 1..channels for the channels
+    std::map<std::string, std::vector<int32_t> > mParams;
+    // Queries in the history buffer
+    std::vector<std::string> mHistory;
+    // Repeat period in ms, zero stopped
+    int mRepeat;
+    clock_t::time_point mNextRepeat;
+    // Emergency stop active
+    bool mEmergency;
+    // Last update of the motor model and last command received
+    clock_t::time_point mLastUpdate;
+    clock_t::time_point mLastCommand;
+    /**
+     * @brief update Move the motor model to now
+     */
+    void update();
+    /**
+     * @brief execute Execute a single command
+     * @param cmd The command with the type
+     * @param record Add the queries in the history buffer
+     * @param out The reply is appended
+     */
+    void execute(const boost::string_ref &cmd, bool record, std::string &out);
+    /**
+     * @brief query The reply of a query
+     * @param name The query
+     * @param args The arguments
+     * @param out The reply is appended
+     * @return false if the query is unknown
+     */
+    bool query(const std::string &name, const std::vector<int32_t> &args, std::string &out);
+    /**
+     * @brief command Execute a command
+     * @param name The command
+     * @param args The arguments
+     * @return false if the command is refused
+     */
+    bool command(const std::string &name, const std::vector<int32_t> &args);
+    /**
+     * @brief param A parameter of the board or of a channel
+     * @param name The parameter
+     * @param channel The channel, zero for the board
+     * @return The value
+     */
+    int32_t param(const std::string &name, size_t channel);
+    /**
+     * @brief setParam Set a parameter of the board or of a channel
+     * @param name The parameter
+     * @param channel The channel, zero for the board
+     * @param value The value
+     */
+    void setParam(const std::string &name, size_t channel, int32_t value);
+    /**
+     * @brief channelValue The value of a telemetry query for a channel
+     * @param name The query
+     * @param channel The channel from 1
+     * @param value The value
+     * @return false if the query is unknown
+     */
+    bool channelValue(const std::string &name, size_t channel, int32_t &value);
+};
+
+}
+
+#endif // BOARD_EMULATOR_H
@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FAULT_INJECTOR_H
+#define FAULT_INJECTOR_H
+
+#include <stdint.h>
+#include <chrono>
+#include <random>
+#include <string>
+
+namespace emulator {
+
+/// Impairments of the serial link
+typedef struct _fault_profile {
+    // Probability to drop a byte
+    double drop_rate;
+    // Probability to corrupt a line
+    double corrupt_rate;
+    // Delay of each reply and uniform jitter in ms
+    double delay;
+    double jitter;
+    // Latency spikes for second and length in ms
+    double burst_rate;
+    double burst_length;
+    // Period of the disconnections in s and length in ms, zero never
+    double disconnect_period;
+    double disconnect_length;
+} fault_profile_t;
+
+/**
+ * @brief get_fault_profile The profile from the name: clean, noisy, laggy, flaky or field
+ * @param name The name of the profile
+ * @param profile The profile
+ * @return false if the name is unknown
+ */
+bool get_fault_profile(const std::string &name, fault_profile_t &profile);
+
+/**
+ * @brief The fault_injector class Apply a fault profile to the bytes exchanged with the driver.
+ * The random sequence is repeatable from the seed
+ */
+class fault_injector
+{
+public:
+    typedef std::chrono::steady_clock clock_t;
+
+    fault_injector(const fault_profile_t &profile, uint32_t seed);
+    /**
+     * @brief impair Drop bytes and corrupt lines
+     * @param data The bytes, modified in place
+     */
+    void impair(std::string &data);
+    /**
+     * @brief latency The delay of a reply sent now, with the latency spikes
+     * @return The delay
+     */
+    clock_t::duration latency();
+    /**
+     * @brief disconnect Time to disconnect the board
+     * @return The length of the disconnection, zero if connected
+     */
+    clock_t::duration disconnect();
+    /// Bytes dropped
+    uint64_t dropped;
+    /// Lines corrupted
+    uint64_t corrupted;
+    /// Latency spikes
+    uint64_t bursts;
+    /// Disconnections
+    uint64_t disconnects;
+
+private:
+    fault_profile_t mProfile;
+    std::mt19937 mRandom;
+    std::uniform_real_distribution<double> mUniform;
+    // End of the latency spike in progress
+    clock_t::time_point mBurstEnd;
+    // Last check of the latency spikes and next disconnection
+    clock_t::time_point mLastBurst;
+    clock_t::time_point mNextDisconnect;
+};
+
+}
+
+#endif // FAULT_INJECTOR_H
@@ -0,0 +1,125 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CONTROL_CYCLE_H
+#define CONTROL_CYCLE_H
+
+#include <cstddef>
+#include <stdint.h>
+
+#include "roboteq/telemetry.h"
+#include "roboteq/tx_buffer.h"
+
+namespace roboteq {
+
+/// Status fields of the board, polled after the telemetry fields
+typedef enum _board_field {
+    BOARD_FAULT = 0,        // FF <-> _FLTFLAG [pag. 245]
+    BOARD_STATUS,           // FS <-> _STFLAG [pag. 247]
+    BOARD_VOLTS_INTERNAL,   // V 1 <-> _VOLTS [pag. 262]
+    BOARD_VOLTS_FIVE,       // V 3 <-> _VOLTS [pag. 262]
+    BOARD_TEMP_MCU,         // T 1 <-> _TEMP [pag. 259]
+    BOARD_TEMP_BRIDGE,      // T 2 <-> _TEMP [pag. 259]
+    BOARD_FIELDS
+} board_field_t;
+
+/// Query and parameters for each status field
+extern const char* const board_query[BOARD_FIELDS][2];
+
+/// Default rate of a polled field
+typedef struct _poll_default {
+    // Name of the rate parameter
+    const char* key;
+    // Rate in Hz, zero every refresh
+    double rate;
+    // Maximum size of the data in the reply
+    size_t reply_size;
+} poll_default_t;
+
+/// Default rates of the telemetry fields
+extern const poll_default_t telemetry_plan[TELEMETRY_FIELDS];
+/// Default rates of the status fields
+extern const poll_default_t board_plan[BOARD_FIELDS];
+
+/// Fraction of the serial port used from the polling
+const double polling_utilization(0.5);
+
+/**
+ * @brief polling_line Bytes moved from the serial port in a refresh, 10 bits for each byte
+ * @param baudrate The baudrate
+ * @param frequency The frequency of the refresh in Hz
+ * @return The bytes in a refresh
+ */
+inline double polling_line(unsigned long baudrate, double frequency)
+{
+    return baudrate / 10.0 / frequency;
+}
+
+/// Commands of all channels shared with the I/O thread
+typedef struct _command_mailbox {
+    int32_t command[max_channels];
+    // Operative mode of each channel [pag. 321]
+    int32_t mode[max_channels];
+    // Bit mask of the channels with a command
+    uint32_t valid;
+} command_mailbox_t;
+
+/**
+ * @brief velocity_command The speed in Roboteq units, per mille of the max speed [pag. 222]
+ * @param rpm The speed of the motor in RPM
+ * @param max_rpm The max speed of the motor in RPM
+ * @return The command
+ */
+inline int32_t velocity_command(double rpm, double max_rpm)
+{
+    return static_cast<int32_t>(static_cast<long long int>(rpm / max_rpm * 1000.0));
+}
+
+/**
+ * @brief combined_channels All channels from the first are in the same velocity mode
+ * @param mailbox The commands
+ * @param channels Number of channels of the board
+ * @return The number of channels of the M command, zero if the channels need a G command each
+ */
+size_t combined_channels(const command_mailbox_t &mailbox, size_t channels);
+
+/**
+ * @brief format_commands Format the commands of a cycle in a single line,
+ * "!M 100 -100" or "!G 1 100_!G 2 -100" [pag. 179]
+ * @param mailbox The commands
+ * @param channels Number of channels of the board
+ * @param combined Use a single M command when all channels share a velocity mode
+ * @param tx The line, not finished
+ */
+void format_commands(const command_mailbox_t &mailbox, size_t channels, bool combined, tx_buffer &tx);
+
+}
+
+#endif // CONTROL_CYCLE_H
@@ -0,0 +1,123 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CONTROL_EXECUTOR_H
+#define CONTROL_EXECUTOR_H
+
+#include <ros/ros.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <time.h>
+
+namespace roboteq
+{
+
+/// Number of buckets of the jitter histogram
+const size_t jitter_buckets = 10;
+
+/// Configuration of the control thread
+typedef struct _executor_config {
+    // Period of the control loop in seconds
+    double period;
+    // SCHED_FIFO priority, 0 normal scheduler
+    int priority;
+    // CPU where run the control thread, -1 all CPU
+    int cpu;
+    // Lock all memory of the process
+    bool lock_memory;
+} executor_config_t;
+
+class ControlExecutor : public diagnostic_updater::DiagnosticTask
+{
+public:
+    /**
+     * @brief ControlExecutor Run the control loop in a dedicated thread with absolute deadlines
+     * @param config The configuration of the thread
+     * @param cycle The control loop: read, update and write
+     */
+    ControlExecutor(const executor_config_t &config, const std::function<void ()> &cycle);
+
+    ~ControlExecutor();
+    /**
+     * @brief start Launch the control thread, SIGINT and SIGTERM are blocked in it
+     */
+    void start();
+    /**
+     * @brief stop Stop and wait the control thread, not from a signal handler
+     */
+    void stop();
+    /**
+     * @brief run Diagnostic with overruns and jitter histogram
+     * @param stat the stat will be updated
+     */
+    void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+    /**
+     * @brief getOverruns Number of cycles ended after the next deadline
+     * @return The number of overruns
+     */
+    uint64_t getOverruns() const
+    {
+        return _overruns.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Configuration
+    executor_config_t _config;
+    // Control loop
+    std::function<void ()> _cycle;
+    // Control thread
+    std::thread _thread;
+    // Used to stop the control thread
+    std::atomic<bool> _running;
+    // Statistics
+    std::atomic<uint64_t> _cycles, _overruns, _missed;
+    std::atomic<int64_t> _max_jitter;
+    std::atomic<uint64_t> _jitter[jitter_buckets];
+    /**
+     * @brief setup Set priority and affinity of the control thread
+     */
+    void setup();
+    /**
+     * @brief loop The control thread
+     */
+    void loop();
+    /**
+     * @brief record Add the wake up delay in the histogram
+     * @param jitter The delay in nanoseconds
+     */
+    void record(int64_t jitter);
+};
+
+}
+
+#endif // CONTROL_EXECUTOR_H
@@ -0,0 +1,179 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <atomic>
+
+#include "roboteq/mapped_file.h"
+#include "roboteq/telemetry.h"
+
+namespace roboteq {
+
+/// A decoded frame of a channel in the flight file
+typedef struct _flight_record {
+    // Index of the record plus one, zero while the record is written
+    uint64_t sequence;
+    // Monotonic time in ns of the newest field
+    uint64_t stamp;
+    // Channel, from zero
+    uint16_t channel;
+    // Bit mask of the fields decoded
+    uint16_t valid;
+    uint32_t reserved;
+    // Raw values from the board, as telemetry_field_t
+    int32_t value[TELEMETRY_FIELDS];
+} flight_record_t;
+
+/// Header of the flight file, followed from the ring of the records
+typedef struct _flight_header {
+    // "RQFLT01"
+    char magic[8];
+    // Size of a record and number of fields, to read old files
+    uint32_t record_size;
+    uint32_t fields;
+    // Number of records in the ring
+    uint64_t capacity;
+    // Records written, the next index
+    uint64_t head;
+    // Wall time minus monotonic time in ns when the file is created
+    int64_t wall_offset;
+    uint64_t reserved[3];
+} flight_header_t;
+
+/**
+ * @brief The flight_recorder class Black box of the decoded telemetry in a preallocated memory
+ * mapped ring file. The frames are written in place without locks and system calls from a single
+ * thread, the one that refresh the telemetry. The file survive a crash of the driver and is moved
+ * in <file>.1 at the next start.
+ */
+class flight_recorder
+{
+public:
+    flight_recorder();
+    ~flight_recorder();
+    /**
+     * @brief start Create the flight file
+     * @param path The file
+     * @param size The size of the file in bytes
+     * @return false if the file is not created
+     */
+    bool start(const std::string &path, size_t size);
+    /**
+     * @brief stop Write the pages and close the file
+     */
+    void stop();
+    bool isEnabled() const
+    {
+        return mEnabled.load(std::memory_order_acquire);
+    }
+    /**
+     * @brief record Add a record for each channel with fields decoded, only from one thread.
+     * The thread must be stopped before stop()
+     * @param frames The frames
+     * @param channels Number of channels
+     */
+    void record(const motor_frame_t *frames, size_t channels)
+    {
+        if(isEnabled())
+            append(frames, channels);
+    }
+    const std::string &error() const
+    {
+        return mError;
+    }
+
+private:
+    std::atomic<bool> mEnabled;
+    std::string mError;
+    mapped_file mFile;
+    flight_header_t* mHeader;
+    flight_record_t* mRing;
+
+    void append(const motor_frame_t *frames, size_t channels);
+};
+
+/**
+ * @brief The flight_reader class Read the records of a flight file, from the oldest
+ */
+class flight_reader
+{
+public:
+    flight_reader();
+    /**
+     * @brief open Map the flight file, also while it is written
+     * @param path The file
+     * @return false if the file is not a flight file
+     */
+    bool open(const std::string &path);
+    void close();
+    /**
+     * @brief next The next record complete, the records overwritten during the read are skipped
+     * @param record The record
+     * @return false at the end of the file
+     */
+    bool next(flight_record_t &record);
+    /**
+     * @brief rewind Restart from the oldest record
+     */
+    void rewind();
+    /**
+     * @brief wall Convert the stamp of a record in wall time
+     * @param stamp The monotonic time in ns
+     * @return The wall time in ns from the epoch
+     */
+    int64_t wall(uint64_t stamp) const
+    {
+        return static_cast<int64_t>(stamp) + mHeaderCopy.wall_offset;
+    }
+    const flight_header_t &header() const
+    {
+        return mHeaderCopy;
+    }
+    const std::string &error() const
+    {
+        return mError;
+    }
+
+private:
+    mapped_file mFile;
+    const flight_record_t* mRing;
+    flight_header_t mHeaderCopy;
+    uint64_t mIndex;
+    std::string mError;
+};
+
+}
+
+#endif // FLIGHT_RECORDER_H
@@ -0,0 +1,197 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <boost/utility/string_ref.hpp>
+
+namespace roboteq {
+
+/**
+ * @brief The latency_histogram class Histogram of latencies in us with log-linear buckets,
+ * as HdrHistogram: 16 linear buckets for each power of two, relative error below 6%.
+ * The record is lock free and without allocations
+ */
+class latency_histogram
+{
+public:
+    /// Linear buckets for each power of two
+    static const unsigned sub_bits = 4;
+    static const unsigned sub_count = 1 << sub_bits;
+    /// Powers of two covered, up to 2^31 us
+    static const unsigned octaves = 28;
+    static const unsigned buckets = (octaves + 1) * sub_count;
+
+    latency_histogram();
+    /**
+     * @brief record Add a latency
+     * @param us The latency in us
+     */
+    void record(uint64_t us)
+    {
+        mCounts[index(us)].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(us, std::memory_order_relaxed);
+        uint64_t max = mMax.load(std::memory_order_relaxed);
+        while(us > max && !mMax.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+    }
+    /**
+     * @brief percentile The latency at a percentile
+     * @param q The percentile in [0, 1]
+     * @return The latency in us, zero without samples
+     */
+    double percentile(double q) const;
+    uint64_t count() const
+    {
+        return mCount.load(std::memory_order_relaxed);
+    }
+    double mean() const;
+    uint64_t max() const
+    {
+        return mMax.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief index The bucket of a latency
+     * @param us The latency in us
+     * @return The bucket
+     */
+    static unsigned index(uint64_t us)
+    {
+        if(us < sub_count)
+            return us;
+        unsigned shift = (63 - __builtin_clzll(us)) - sub_bits;
+        if(shift >= octaves)
+            return buckets - 1;
+        return (shift + 1) * sub_count + ((us >> shift) - sub_count);
+    }
+    /**
+     * @brief value The middle of a bucket
+     * @param idx The bucket
+     * @return The latency in us
+     */
+    static double value(unsigned idx);
+
+private:
+    std::atomic<uint32_t> mCounts[buckets];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+    std::atomic<uint64_t> mMax;
+};
+
+/// Statistics of a mnemonic, latencies in us
+typedef struct _latency_summary {
+    std::string name;
+    uint64_t count;
+    uint64_t retries;
+    uint64_t timeouts;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double p999;
+    double max;
+} latency_summary_t;
+
+/**
+ * @brief mnemonic_key Pack a mnemonic in an integer, up to 8 characters and the first space
+ * @param name The mnemonic
+ * @return The key, zero for an empty mnemonic
+ */
+inline uint64_t mnemonic_key(const boost::string_ref &name)
+{
+    uint64_t key = 0;
+    for(size_t i = 0; i < name.size() && i < sizeof(key) && name[i] != ' '; ++i)
+        key |= static_cast<uint64_t>(static_cast<unsigned char>(name[i])) << (8 * i);
+    return key;
+}
+
+/**
+ * @brief The command_latency class Latency histograms, retries and timeouts for each mnemonic.
+ * The table has a fixed size and the new mnemonics are inserted lock free
+ */
+class command_latency
+{
+public:
+    /// Maximum number of mnemonics
+    static const size_t max_mnemonics = 64;
+
+    command_latency();
+    /**
+     * @brief record Add the latency of a reply
+     * @param key The mnemonic
+     * @param us The latency in us
+     */
+    void record(uint64_t key, uint64_t us);
+    /**
+     * @brief retry A request is sent again
+     * @param key The mnemonic
+     */
+    void retry(uint64_t key);
+    /**
+     * @brief timeout A request without reply
+     * @param key The mnemonic
+     */
+    void timeout(uint64_t key);
+    /**
+     * @brief summary The statistics of all mnemonics, ordered by name
+     * @param summary The statistics
+     */
+    void summary(std::vector<latency_summary_t> &summary) const;
+    /**
+     * @brief dump The statistics as a table
+     * @return The table
+     */
+    std::string dump() const;
+
+private:
+    typedef struct _slot {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> retries;
+        std::atomic<uint64_t> timeouts;
+        latency_histogram histogram;
+    } slot_t;
+    slot_t mSlots[max_mnemonics];
+    /**
+     * @brief find The slot of a mnemonic, a new one is inserted
+     * @param key The mnemonic
+     * @return The slot, NULL if the key is empty or the table is full
+     */
+    slot_t* find(uint64_t key);
+};
+
+}
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,130 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LINE_FRAMER_H
+#define LINE_FRAMER_H
+
+#include <cstddef>
+#include <boost/utility/string_ref.hpp>
+
+namespace roboteq {
+
+/// Type of line received from the Roboteq board
+typedef enum _line_type {
+    LINE_EMPTY,
+    LINE_ACK,       // "+" command accepted
+    LINE_NACK,      // "-" command refused
+    LINE_QUERY,     // "NAME=DATA" reply of a query
+    LINE_HLD,       // "HLD" ready to download a script
+    LINE_OTHER
+} line_type_t;
+
+/**
+ * @brief scan_line Decode a line received without allocations
+ * @param line The line without the end of line
+ * @param name The mnemonic of the query, slice of the line
+ * @param data The data of the query, slice of the line
+ * @return The type of line
+ */
+line_type_t scan_line(const boost::string_ref &line, boost::string_ref &name, boost::string_ref &data);
+
+/**
+ * @brief The line_framer class Fixed size ring buffer to split in lines all bytes received.
+ * The lines are returned as slices of the buffer, without copy and allocations.
+ */
+class line_framer
+{
+public:
+    /// Size of the ring buffer, power of two
+    static const size_t buffer_size = 1024;
+    /// Maximum length of a line
+    static const size_t max_line_length = 256;
+
+    line_framer();
+    /**
+     * @brief prepare Contiguous free space where write the bytes received.
+     * All lines returned from next() are not valid after this call
+     * @param size The size of the free space
+     * @return The pointer to the free space
+     */
+    char* prepare(size_t &size);
+    /**
+     * @brief commit Add in the buffer the bytes written in the space returned from prepare()
+     * @param size The number of bytes written
+     */
+    void commit(size_t size);
+    /**
+     * @brief next Extract the next line complete
+     * @param line The slice with the line without the end of line
+     * @return true if a line is complete
+     */
+    bool next(boost::string_ref &line);
+    /**
+     * @brief overflows Number of lines dropped because too long
+     * @return The number of lines dropped
+     */
+    size_t overflows() const
+    {
+        return mOverflows;
+    }
+    /**
+     * @brief empty Check if all bytes received are returned in lines
+     * @return True if there is no partial line in the buffer
+     */
+    bool empty() const
+    {
+        return mTail == mHead;
+    }
+    /**
+     * @brief clear Drop all bytes in the buffer
+     */
+    void clear()
+    {
+        mTail = mScan = mHead;
+    }
+
+private:
+    // Ring buffer
+    char mBuffer[buffer_size];
+    // Line linearized when wrap around the end of the ring buffer
+    char mLine[max_line_length];
+    // Write position
+    size_t mHead;
+    // Start of the first line not returned
+    size_t mTail;
+    // Position already scanned looking the end of line
+    size_t mScan;
+    // Lines dropped
+    size_t mOverflows;
+};
+
+}
+
+#endif // LINE_FRAMER_H
@@ -0,0 +1,127 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LINK_MONITOR_H
+#define LINK_MONITOR_H
+
+#include <stdint.h>
+#include <chrono>
+
+namespace roboteq {
+
+/// Statistics of the serial link
+typedef struct _link_stats {
+    // Smoothed round trip time and variation in us
+    double srtt;
+    double rttvar;
+    // Timeout of a new request in us
+    double rto;
+    // Round trip samples
+    uint64_t samples;
+    // Requests lost or without reply
+    uint64_t timeouts;
+    // Requests sent again
+    uint64_t retries;
+    // Serial port opened again after an error
+    uint64_t reconnects;
+    // Too many requests lost in a row
+    bool degraded;
+} link_stats_t;
+
+/**
+ * @brief The link_monitor class Estimate the round trip time of the requests and derive the timeout
+ * of a new request, with the same estimator of TCP (RFC 6298). After many requests lost in a row
+ * the link is degraded until the first reply received.
+ */
+class link_monitor
+{
+public:
+    typedef std::chrono::steady_clock::duration duration_t;
+
+    link_monitor();
+    /**
+     * @brief sample Add a round trip time measured
+     * @param rtt The round trip time
+     */
+    void sample(duration_t rtt);
+    /**
+     * @brief timeout The timeout of a request, doubled for every attempt
+     * @param attempt The attempt of the request, zero the first
+     * @return The timeout
+     */
+    duration_t timeout(unsigned int attempt) const;
+    /**
+     * @brief success A request is replied
+     * @return true if the link was degraded
+     */
+    bool success();
+    /**
+     * @brief failure A request is lost or without reply
+     * @return true if the link is degraded now
+     */
+    bool failure();
+    /**
+     * @brief retry A request is sent again
+     */
+    void retry()
+    {
+        mStats.retries++;
+    }
+    /**
+     * @brief reconnect The serial port is opened again after an error
+     */
+    void reconnect()
+    {
+        mStats.reconnects++;
+    }
+    /**
+     * @brief degraded Too many requests lost in a row
+     * @return true if degraded
+     */
+    bool degraded() const
+    {
+        return mStats.degraded;
+    }
+    /**
+     * @brief getStats The statistics of the link
+     * @return The statistics
+     */
+    link_stats_t getStats() const;
+
+private:
+    // Statistics and estimator state in us
+    link_stats_t mStats;
+    // Requests lost in a row
+    unsigned int mFailures;
+};
+
+}
+
+#endif // LINK_MONITOR_H
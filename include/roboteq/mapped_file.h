@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+namespace roboteq {
+
+/**
+ * @brief The mapped_file class A file mapped in memory with MAP_SHARED. The pages written
+ * are in the page cache and survive a crash of the process
+ */
+class mapped_file
+{
+public:
+    mapped_file();
+    ~mapped_file();
+    /**
+     * @brief create Create or truncate the file, reserve all blocks and map it read write
+     * @param path The file
+     * @param size The size of the file
+     * @return false if the file is not created, the reason in error()
+     */
+    bool create(const std::string &path, size_t size);
+    /**
+     * @brief open Map read only an existing file
+     * @param path The file
+     * @return false if the file is not mapped, the reason in error()
+     */
+    bool open(const std::string &path);
+    /**
+     * @brief sync Write the pages modified in the file
+     */
+    void sync();
+    /**
+     * @brief close Unmap and close the file
+     */
+    void close();
+    /**
+     * @brief isOpen The file is mapped
+     */
+    bool isOpen() const
+    {
+        return mMap != NULL;
+    }
+    char* data() const
+    {
+        return mMap;
+    }
+    size_t size() const
+    {
+        return mSize;
+    }
+    const std::string &error() const
+    {
+        return mError;
+    }
+
+private:
+    int mFd;
+    char* mMap;
+    size_t mSize;
+    std::string mError;
+};
+
+}
+
+#endif // MAPPED_FILE_H
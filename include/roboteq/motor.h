@@ -44,6 +44,8 @@
 #include <roboteq_control/ControlStatus.h>
 
 #include "roboteq/serial_controller.h"
+#include "roboteq/seqlock.h"
+#include "roboteq/telemetry.h"
 #include "configurator/gpio_sensor.h"
 #include "configurator/motor_param.h"
 #include "configurator/motor_pid.h"
@@ -62,6 +64,14 @@ typedef struct _motor_status {
     uint8_t : 1;
 } motor_status_t;
 
+/// Last state of the motor given to the diagnostics
+typedef struct _motor_state {
+    double position, velocity, effort;
+    double pwm, loop_error;
+    double volts, amps_motor, amps_batt, track;
+    motor_status_t status;
+} motor_state_t;
+
 class Motor : public diagnostic_updater::DiagnosticTask
 {
 public:
@@ -98,6 +108,12 @@ public:
      * @param period the period update
      */
     void writeCommandsToHardware(ros::Duration period);
+    /**
+     * @brief buildCommand Enforce the joint limits and convert the command in Roboteq units
+     * @param period the period update
+     * @return The command for the G message [pag. 222]
+     */
+    int32_t buildCommand(ros::Duration period);
     /**
      * @brief switchController Switch the controller from different type of ros controller
      * @param type the type of ros controller
@@ -122,6 +138,13 @@ public:
     string getName() {
         return mMotorName;
     }
+    /**
+     * @brief getControlMode The operative mode of the motor [pag. 321]
+     * @return The operative mode, -1 if the motor is not controlled
+     */
+    int getControlMode() {
+        return _control_mode;
+    }
     /**
      * @brief registerSensor register the sensor
      * @param sensor the sensor interface
@@ -131,10 +154,10 @@ public:
         _sensor = sensor;
     }
     /**
-     * @brief readVector Decode vector data list
-     * @param fields field of measures
+     * @brief readVector Convert the telemetry frame of this motor
+     * @param frame the raw values read from the board
      */
-    void readVector(std::vector<std::string> fields);
+    void readVector(const motor_frame_t &frame);
 
     hardware_interface::JointStateHandle joint_state_handle;
     hardware_interface::JointHandle joint_handle;
@@ -190,8 +213,10 @@ private:
     double effort, max_effort;
     double command;
 
-    int _control_mode;
+    std::atomic<int> _control_mode;
     motor_status_t _status;
+    // State of the control loop read from the diagnostics
+    seqlock<motor_state_t> _state;
 
     /// ROS joint limits interface
     joint_limits_interface::VelocityJointSoftLimitsInterface vel_limits_interface;
@@ -209,9 +234,6 @@ private:
 
     GPIOSensor* _sensor;
 
-    // Reader motor message
-    void read(string data);
-
     void connectionCallback(const ros::SingleSubscriberPublisher& pub);
 };
 
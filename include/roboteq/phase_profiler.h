@@ -0,0 +1,127 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PHASE_PROFILER_H
+#define PHASE_PROFILER_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "roboteq/polling_planner.h"
+#include "roboteq/trace_recorder.h"
+
+namespace roboteq
+{
+
+/// Phases of the control cycle
+typedef enum _cycle_phase {
+    PHASE_READ,             // Roboteq::read
+    PHASE_READ_TELEMETRY,   // Telemetry snapshot, polling and decode of the frames
+    PHASE_READ_GPIO,        // Read of the GPIO
+    PHASE_UPDATE,           // Controller manager update
+    PHASE_WRITE,            // Roboteq::write
+    PHASE_CYCLE,            // Whole control cycle
+    CYCLE_PHASES
+} cycle_phase_t;
+
+/// Number of buckets of each phase histogram
+const size_t phase_buckets = 12;
+/// Upper limit of each bucket in microseconds
+extern const int64_t phase_limits[phase_buckets];
+/// Names of the phases
+extern const char *const phase_names[CYCLE_PHASES];
+
+/// Statistics of a phase in an interval
+typedef struct _phase_stats {
+    // Cycles measured
+    uint64_t count;
+    // Sum and max of the durations in ns
+    uint64_t sum;
+    uint64_t max;
+    // Histogram of the durations
+    uint64_t buckets[phase_buckets];
+} phase_stats_t;
+
+class phase_profiler
+{
+public:
+    phase_profiler();
+    /**
+     * @brief record Add the duration of a phase, lock free, called from the control loop
+     * @param phase The phase
+     * @param duration The duration in ns
+     */
+    void record(cycle_phase_t phase, uint64_t duration);
+    /**
+     * @brief collect Read and clear the statistics of all phases, a single reader
+     * @param stats The statistics of each phase since the last collect
+     */
+    void collect(phase_stats_t *stats);
+
+private:
+    // Statistics of each phase
+    std::atomic<uint64_t> _count[CYCLE_PHASES];
+    std::atomic<uint64_t> _sum[CYCLE_PHASES];
+    std::atomic<uint64_t> _max[CYCLE_PHASES];
+    std::atomic<uint64_t> _buckets[CYCLE_PHASES][phase_buckets];
+};
+
+/// Measure a phase from the construction to the end of the scope
+class phase_timer
+{
+public:
+    /**
+     * @brief phase_timer Start the measure of a phase
+     * @param profiler The profiler
+     * @param phase The phase
+     */
+    phase_timer(phase_profiler &profiler, cycle_phase_t phase)
+        : _profiler(profiler)
+        , _phase(phase)
+        , _start(monotonic_ns())
+    {
+        ROBOTEQ_TRACE(phase_begin, phase, 0);
+    }
+
+    ~phase_timer()
+    {
+        _profiler.record(_phase, monotonic_ns() - _start);
+        ROBOTEQ_TRACE(phase_end, _phase, 0);
+    }
+
+private:
+    phase_profiler &_profiler;
+    cycle_phase_t _phase;
+    uint64_t _start;
+};
+
+}
+
+#endif // PHASE_PROFILER_H
@@ -0,0 +1,161 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef POLLING_PLANNER_H
+#define POLLING_PLANNER_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+namespace roboteq {
+
+/**
+ * @brief monotonic_ns Monotonic time used for the freshness of the values
+ * @return The time in nanoseconds
+ */
+inline uint64_t monotonic_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// A query polled with its own rate
+typedef struct _poll_entry {
+    // Query and parameters
+    std::string name;
+    std::string params;
+    // Period in ns, zero every cycle
+    uint64_t period;
+    // Bytes sent and received for this query
+    size_t tx_size;
+    size_t rx_size;
+    // The query is in the plan
+    bool enabled;
+    // Next time the query is due
+    uint64_t next;
+    // Last time the reply is received, zero never
+    uint64_t stamp;
+} poll_entry_t;
+
+/**
+ * @brief The polling_planner class Select every cycle the queries due, packed in a batch
+ * that fit the bytes available on the serial port. The queries of every cycle are always selected,
+ * ahead of the budget. The others share the bytes left, the most late first and at least one
+ * every cycle; the queries left out are late in the next cycle.
+ */
+class polling_planner
+{
+public:
+    polling_planner();
+    /**
+     * @brief add Add a query in the plan
+     * @param name The query
+     * @param params The parameters of the query
+     * @param rate The rate in Hz, zero or negative every cycle
+     * @param reply_size The maximum size of the data in the reply
+     * @return The index of the query
+     */
+    size_t add(const std::string &name, const std::string &params, double rate, size_t reply_size);
+    /**
+     * @brief setRate Change the rate of a query
+     * @param index The index of the query
+     * @param rate The rate in Hz, zero or negative every cycle
+     */
+    void setRate(size_t index, double rate);
+    /**
+     * @brief enable Add or remove a query from the plan
+     * @param index The index of the query
+     * @param enabled The status
+     */
+    void enable(size_t index, bool enabled);
+    /**
+     * @brief setBudget Set the bytes available in a cycle, for each direction
+     * @param bytes The bytes available
+     */
+    void setBudget(size_t bytes);
+    /**
+     * @brief getBudget The bytes available in a cycle
+     * @return The bytes available
+     */
+    size_t getBudget() const
+    {
+        return mBudget;
+    }
+    /**
+     * @brief reserved The bytes of the queries of every cycle, in the direction most loaded
+     * @return The bytes reserved ahead of the budget
+     */
+    size_t reserved() const;
+    /**
+     * @brief plan Select the queries due in this cycle
+     * @param now The time of the cycle
+     * @param batch The indexes of the queries selected
+     * @param credit Bytes not used from other traffic, added to the budget of this cycle
+     */
+    void plan(uint64_t now, std::vector<size_t> &batch, size_t credit=0);
+    /**
+     * @brief update Mark a query as received
+     * @param index The index of the query
+     * @param now The time of the reply
+     */
+    void update(size_t index, uint64_t now)
+    {
+        mEntries[index].stamp = now;
+    }
+    /**
+     * @brief entry A query of the plan
+     * @param index The index of the query
+     * @return The query
+     */
+    const poll_entry_t &entry(size_t index) const
+    {
+        return mEntries[index];
+    }
+    /**
+     * @brief size Number of queries in the plan
+     * @return The number of queries
+     */
+    size_t size() const
+    {
+        return mEntries.size();
+    }
+
+private:
+    // All queries
+    std::vector<poll_entry_t> mEntries;
+    // Bytes available in a cycle for each direction
+    size_t mBudget;
+};
+
+}
+
+#endif // POLLING_PLANNER_H
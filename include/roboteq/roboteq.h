@@ -32,11 +32,11 @@
 #define ROBOTEQ_H
 
 #include <ros/ros.h>
-#include <serial/serial.h>
 
 #include <std_msgs/Bool.h>
 #include <roboteq_control/Service.h>
 #include <roboteq_control/Peripheral.h>
+#include <roboteq_control/CycleProfile.h>
 
 #include <diagnostic_updater/diagnostic_updater.h>
 #include <diagnostic_updater/publisher.h>
@@ -48,7 +48,17 @@
 #include "configurator/gpio_pulse.h"
 #include "configurator/gpio_encoder.h"
 #include "roboteq/serial_controller.h"
+#include "roboteq/telemetry.h"
+#include "roboteq/control_cycle.h"
+#include "roboteq/seqlock.h"
+#include "roboteq/polling_planner.h"
 #include "roboteq/motor.h"
+#include "roboteq/phase_profiler.h"
+#include "roboteq/flight_recorder.h"
+#include "roboteq/telemetry_archive.h"
+
+#include <atomic>
+#include <thread>
 
 using namespace std;
 
@@ -86,6 +96,21 @@ typedef struct _status_fault {
     uint8_t mosfet_failure : 1;
 } status_fault_t;
 
+/// Status of the board shared with the diagnostic
+typedef struct _board_status {
+    // Raw values from the board
+    int32_t value[BOARD_FIELDS];
+    // Bit mask of the fields decoded
+    uint32_t valid;
+    // Monotonic time in ns when each field is received, zero never
+    uint64_t stamp[BOARD_FIELDS];
+} board_status_t;
+
+/// Telemetry of all channels shared with the control loop
+typedef struct _telemetry_snapshot {
+    motor_frame_t frames[max_channels];
+} telemetry_snapshot_t;
+
 class Roboteq : public hardware_interface::RobotHW, public diagnostic_updater::DiagnosticTask
 {
 public:
@@ -120,6 +145,22 @@ public:
     void updateDiagnostics();
 
     void initializeDiagnostic();
+    /**
+     * @brief addDiagnostic Add an external task in the diagnostic of the board
+     * @param task The diagnostic task
+     */
+    void addDiagnostic(diagnostic_updater::DiagnosticTask &task)
+    {
+        diagnostic_updater.add(task);
+    }
+    /**
+     * @brief getProfiler Timing of the phases of the control cycle
+     * @return The phase profiler
+     */
+    phase_profiler& getProfiler()
+    {
+        return _profiler;
+    }
 
     void write(const ros::Time& time, const ros::Duration& period);
 
@@ -140,6 +181,8 @@ private:
     diagnostic_updater::Updater diagnostic_updater;
     // Publisher status periheral
     ros::Publisher pub_peripheral;
+    // Publisher timing of the control cycle
+    ros::Publisher pub_profile;
     // stop publisher
     ros::Subscriber sub_stop;
     // Service board
@@ -169,18 +212,140 @@ private:
     double _volts_internal, _volts_five;
     // Tempearture inside the Roboteq board
     double _temp_mcu, _temp_bridge;
+    // Age of the oldest status field in seconds
+    double _status_age;
 
-    // GPIO enable read
-    bool _isGPIOreading;
+    // GPIO enable read, set from the ROS spinner and read from the I/O thread
+    std::atomic<bool> _isGPIOreading;
     roboteq_control::Peripheral msg_peripheral;
     std::vector<GPIOAnalogConfigurator*> _param_analog;
     std::vector<GPIOPulseConfigurator*> _param_pulse;
     // Encoder
     std::vector<GPIOEncoderConfigurator*> _param_encoder;
 
+    // Number of channels decoded
+    size_t _channels;
+    // Frames of all channels used in the control loop
+    telemetry_snapshot_t _snapshot;
+    // Telemetry requests reused every refresh
+    std::vector<request_ptr> _telemetry_requests;
+    // Rate of each telemetry and status field
+    polling_planner _planner;
+    // Fields selected in a refresh
+    std::vector<size_t> _poll_batch;
+    std::vector<query_t> _poll_queries;
+    // Status of the board in decoding
+    board_status_t _poll_board;
+    // Last status of the board received
+    seqlock<board_status_t> _board;
+    // Telemetry stream period in ms, zero polling mode
+    int _stream_period;
+    // Frames in decoding from the telemetry stream
+    telemetry_snapshot_t _stream_snapshot;
+    // Last telemetry received from the I/O thread or from the stream
+    seqlock<telemetry_snapshot_t> _state;
+    // Last commands from the control loop
+    seqlock<command_mailbox_t> _commands;
+
+    // I/O thread enabled
+    bool _io_enable;
+    // Refresh period of the telemetry in the I/O thread
+    double _io_period;
+    // I/O thread, owns all traffic of the control loop
+    std::thread _io_thread;
+    std::atomic<bool> _io_running;
+    // Wake up the I/O thread with new commands
+    std::mutex _io_mutex;
+    std::condition_variable _io_cv;
+    // Frames refreshed from the I/O thread
+    telemetry_snapshot_t _io_snapshot;
+    // Commands of a cycle formatted in a single line
+    tx_buffer _tx;
+    // Use a single M command for all channels in the same velocity mode
+    bool _combined_command;
+    // Last commands sent to the board
+    command_mailbox_t _last_mailbox;
+    size_t _last_tx_size;
+    uint64_t _last_tx_time;
+    // Commands inside the deadband of the last sent are suppressed, in Roboteq units
+    int _deadband;
+    // Period of the control loop in s, the commands are sent once every period
+    double _control_period;
+    // Serial watchdog of the board in ms [pag. 330], at least two control periods
+    int _watchdog;
+    // Maximum time between two commands to keep the watchdog alive, in ns
+    uint64_t _keepalive;
+    // Bytes of the commands suppressed, given to the polling
+    size_t _poll_credit;
+    // Commands sent and suppressed
+    std::atomic<unsigned long> _commands_sent, _commands_suppressed;
+    // Command requests of the last cycle, the acknowledges are checked in the next cycle
+    std::vector<request_ptr> _command_requests;
+    // Timing of the phases of the control cycle
+    phase_profiler _profiler;
+    roboteq_control::CycleProfile msg_profile;
+    // File and number of events of the timeline
+    string _trace_file;
+    int _trace_events;
+    // Black box of the frames decoded, written from the thread that refresh the telemetry
+    flight_recorder _flight;
+    // Archive of the frames given to the motors, in column chunks
+    archive_writer _archive;
+
 
     // stop callback
     void stop_Callback(const std_msgs::Bool::ConstPtr& msg);
+    /**
+     * @brief setupPollingPlan Load the rate of each field and the bytes available in a refresh
+     * @param frequency The refresh frequency
+     */
+    void setupPollingPlan(double frequency);
+    /**
+     * @brief pollTelemetry Send the telemetry and status queries due in one line and decode the replies
+     * @param frames The frames of all channels
+     */
+    void pollTelemetry(motor_frame_t *frames);
+    /**
+     * @brief readGPIO Read and publish the status of all GPIO
+     */
+    void readGPIO();
+    /**
+     * @brief publishProfile Publish the timing of the control cycle since the last call
+     */
+    void publishProfile();
+    /**
+     * @brief sendCommands Send the commands of all channels with a single write, without wait the replies
+     * @param mailbox The commands
+     */
+    void sendCommands(const command_mailbox_t &mailbox);
+    /**
+     * @brief setupWatchdog Configure the serial watchdog of the board and the keep alive of the commands.
+     * The keep alive runs in the control loop and can not be faster than the control period,
+     * a watchdog shorter than two control periods is raised
+     */
+    void setupWatchdog();
+    /**
+     * @brief startIOThread Launch the thread that refresh the telemetry and send the commands
+     */
+    void startIOThread();
+    /**
+     * @brief stopIOThread Stop and wait the I/O thread
+     */
+    void stopIOThread();
+    /**
+     * @brief ioLoop The I/O thread
+     */
+    void ioLoop();
+    /**
+     * @brief startTelemetryStream Arm the repeat buffer of the board with the telemetry queries
+     */
+    void startTelemetryStream();
+    /**
+     * @brief streamCallback Collect a field repeated from the board
+     * @param field The number of the telemetry query
+     * @param data The data received
+     */
+    void streamCallback(size_t field, const boost::string_ref data);
     /**
      * @brief getRoboteqInformation Load basic information from roboteq board
      */
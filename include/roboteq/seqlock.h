@@ -0,0 +1,102 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <stdint.h>
+
+namespace roboteq {
+
+/**
+ * @brief The seqlock class Share a snapshot between one writer and many readers without locks.
+ * The writer never waits, the readers retry if the snapshot change during the copy.
+ * T must be trivially copyable.
+ */
+template <class T>
+class seqlock
+{
+public:
+    seqlock()
+        : mSequence(0)
+        , mData()
+    {
+    }
+    /**
+     * @brief write Publish a new snapshot, only one writer at time
+     * @param value The new snapshot
+     */
+    void write(const T &value)
+    {
+        uint32_t sequence = mSequence.load(std::memory_order_relaxed);
+        // Odd sequence, write in progress
+        mSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mData = value;
+        // Even sequence, snapshot stable
+        mSequence.store(sequence + 2, std::memory_order_release);
+    }
+    /**
+     * @brief read Copy the last snapshot
+     * @param value The snapshot
+     * @return The sequence of the snapshot, change with every write
+     */
+    uint32_t read(T &value) const
+    {
+        uint32_t before, after;
+        do
+        {
+            before = mSequence.load(std::memory_order_acquire);
+            value = mData;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = mSequence.load(std::memory_order_relaxed);
+        } while((before & 1) || before != after);
+        return before;
+    }
+    /**
+     * @brief sequence The sequence of the last snapshot
+     * @return The sequence
+     */
+    uint32_t sequence() const
+    {
+        return mSequence.load(std::memory_order_acquire);
+    }
+
+private:
+    // Even when the snapshot is stable
+    std::atomic<uint32_t> mSequence;
+    // Snapshot
+    T mData;
+};
+
+}
+
+#endif // SEQLOCK_H
@@ -32,19 +32,63 @@
 #define SERIAL_CONTROLLER_H
 
 #include <ros/ros.h>
-#include <serial/serial.h>
 
 #include <mutex>
 #include <condition_variable>  // std::condition_variable
+#include <memory>
+#include <atomic>
+#include <deque>
+#include <algorithm>
 
 #include <thread>
 
+#include "roboteq/line_framer.h"
+#include "roboteq/transport.h"
+#include "roboteq/traffic_scheduler.h"
+#include "roboteq/link_monitor.h"
+#include "roboteq/tx_buffer.h"
+#include "roboteq/session_capture.h"
+#include "roboteq/latency_histogram.h"
+
 using namespace std;
 
 namespace roboteq {
 
-/// Read complete callback - Array of callback
-typedef function<void (string data) > callback_data_t;
+/// Read complete callback - Array of callback. The data is a slice valid only during the call
+typedef function<void (const boost::string_ref data) > callback_data_t;
+
+/**
+ * @brief The request_t struct A request in flight to the Roboteq board.
+ * Every caller own a completion slot, the replies are matched in FIFO order
+ */
+typedef struct _request {
+    // Mnemonic expected in the reply, empty for commands
+    string name;
+    // Mnemonic of the request packed for the latency statistics
+    uint64_t mnemonic;
+    // True when the reply is arrived or the request is lost
+    bool done;
+    // True if the board replied to this request
+    bool received;
+    // Status of the reply: "+" for commands, data received for queries
+    bool status;
+    // Data received from a query
+    string data;
+    // Attempt of the transmission, zero for the first
+    unsigned int attempt;
+    // Bytes of the line for this request, to estimate the time on the line
+    size_t bytes;
+    // Time of transmission and time limit to wait the reply
+    std::chrono::steady_clock::time_point sent;
+    std::chrono::steady_clock::time_point deadline;
+    // Notify the owner of the request
+    condition_variable cv;
+} request_t;
+
+typedef std::shared_ptr<request_t> request_ptr;
+
+/// Query and parameters, used to build a batch of queries
+typedef std::pair<string, string> query_t;
 
 class serial_controller
 {
@@ -55,6 +99,12 @@ public:
      * @param set the baudrate
      */
     serial_controller(string port, unsigned long baudrate);
+    /**
+     * @brief serial_controller Use a transport already created
+     * @param link The transport, owned from the controller
+     * @param baudrate The baudrate, used to estimate the time on the line
+     */
+    serial_controller(transport* link, unsigned long baudrate);
 
     ~serial_controller();
     /**
@@ -63,25 +113,175 @@ public:
      */
     bool start();
     /**
-     * @brief stop
-     * @return
+     * @brief stop Stop the stream and the reader and close the port, nothing if already stopped
+     * @return true
      */
     bool stop();
 
-    bool command(string msg, string params="", string type="!");
+    bool command(string msg, string params="", string type="!", priority_t priority=PRIORITY_AUTO);
 
-    bool query(string msg, string params="", string type="?");
+    bool query(string msg, string params="", string type="?", priority_t priority=PRIORITY_AUTO);
+    /**
+     * @brief asyncCommand Send a command without wait the reply
+     * @param msg The command
+     * @param params The parameters of the command
+     * @param type The type of command
+     * @param priority The priority class, selected from the message if automatic
+     * @return The request to wait with wait()
+     */
+    request_ptr asyncCommand(string msg, string params="", string type="!", priority_t priority=PRIORITY_AUTO);
+    /**
+     * @brief asyncQuery Send a query without wait the reply.
+     * More queries can be in flight at the same time, the replies are matched in FIFO order
+     * @param msg The query
+     * @param params The parameters of the query
+     * @param type The type of query
+     * @param priority The priority class, selected from the message if automatic
+     * @return The request to wait with wait()
+     */
+    request_ptr asyncQuery(string msg, string params="", string type="?", priority_t priority=PRIORITY_AUTO);
+    /**
+     * @brief asyncBatch Send all queries in a single line without wait the replies
+     * @param queries The list of queries with parameters
+     * @param type The type of query
+     * @param priority The priority class, selected from the type if automatic
+     * @return The requests in the same order of the queries
+     */
+    vector<request_ptr> asyncBatch(const vector<query_t> &queries, string type="?", priority_t priority=PRIORITY_AUTO);
+    /**
+     * @brief asyncBatch Send all queries in a single line reusing the requests already completed
+     * @param queries The list of queries with parameters
+     * @param requests The requests in the same order of the queries
+     * @param type The type of query
+     * @param priority The priority class, selected from the type if automatic
+     */
+    void asyncBatch(const vector<query_t> &queries, vector<request_ptr> &requests, string type="?", priority_t priority=PRIORITY_AUTO);
+    /**
+     * @brief asyncCommands Send all commands formatted in a line with a single write, without wait the replies.
+     * The requests still in flight are not reused
+     * @param line The commands formatted
+     * @param requests The requests in the same order of the commands
+     * @param priority The priority class
+     */
+    void asyncCommands(const tx_buffer &line, vector<request_ptr> &requests, priority_t priority=PRIORITY_COMMAND);
+    /**
+     * @brief poll Check without wait if a request is closed, a request after the deadline is closed as lost
+     * @param request The request sent
+     * @return true if the request is closed
+     */
+    bool poll(const request_ptr &request);
+    /**
+     * @brief batchQuery Send all queries in a single line and collect all replies
+     * @param queries The list of queries with parameters
+     * @param frame The data received in the same order of the queries, empty if lost
+     * @return true if all replies are received
+     */
+    bool batchQuery(const vector<query_t> &queries, vector<string> &frame);
+    /**
+     * @brief batchQuery Send all queries in a single line and wait all replies, reusing the requests
+     * @param queries The list of queries with parameters
+     * @param requests The requests in the same order of the queries
+     * @param priority The priority class
+     * @return true if all replies are received
+     */
+    bool batchQuery(const vector<query_t> &queries, vector<request_ptr> &requests, priority_t priority=PRIORITY_FEEDBACK);
+    /**
+     * @brief startStream Fill the history buffer of the board with the queries and
+     * repeat it every period. The replies are sent to the callbacks [pag. 179]
+     * @param queries The list of queries with parameters
+     * @param period The repeat period in milliseconds
+     * @return true if the stream is started
+     */
+    bool startStream(const vector<query_t> &queries, unsigned int period);
+    /**
+     * @brief stopStream Stop the repeat and clear the history buffer
+     */
+    void stopStream();
+    /**
+     * @brief isStreaming The board is repeating the history buffer
+     * @return true if the stream is running
+     */
+    bool isStreaming()
+    {
+        std::lock_guard<std::mutex> lck(mReaderMutex);
+        return !mStream.empty();
+    }
+    /**
+     * @brief getBaudrate The baudrate of the serial port
+     * @return The baudrate
+     */
+    uint32_t getBaudrate()
+    {
+        return mBaudrate;
+    }
+    /**
+     * @brief getStats The traffic statistics of a priority class
+     * @param priority The priority class
+     * @return The statistics
+     */
+    class_stats_t getStats(priority_t priority)
+    {
+        return mScheduler.getStats(priority);
+    }
+    /**
+     * @brief setShare Set the fraction of the bandwidth reserved to a priority class
+     * @param priority The priority class
+     * @param share The fraction of the bandwidth [0, 1]
+     */
+    void setShare(priority_t priority, double share)
+    {
+        mScheduler.setShare(priority, share);
+    }
+    /**
+     * @brief setRetryBudget Set the attempts of a transaction for a priority class
+     * @param priority The priority class
+     * @param attempts The number of attempts, at least one
+     */
+    void setRetryBudget(priority_t priority, unsigned int attempts)
+    {
+        mRetryBudget[priority] = std::max(attempts, 1u);
+    }
+    /**
+     * @brief getLinkStats The round trip time and the status of the serial link
+     * @return The statistics
+     */
+    link_stats_t getLinkStats()
+    {
+        std::lock_guard<std::mutex> lck(mReaderMutex);
+        return mLink.getStats();
+    }
+    /**
+     * @brief getLatency The latency, retries and timeouts of each mnemonic
+     * @return The statistics
+     */
+    const command_latency &getLatency() const
+    {
+        return mLatency;
+    }
+    /**
+     * @brief startCapture Write all bytes exchanged with the board in a capture file
+     * @param path The file
+     * @param size The size of the ring in bytes
+     * @return false if the file is not created
+     */
+    bool startCapture(const string &path, size_t size);
+    /**
+     * @brief stopCapture Write the records pending and close the capture file
+     */
+    void stopCapture()
+    {
+        mCapture.stop();
+    }
+    /**
+     * @brief wait Wait the reply of a request until the deadline
+     * @param request The request sent
+     * @return true if the reply is arrived and is valid
+     */
+    bool wait(const request_ptr &request);
 
-    string getQuery(string msg, string params="")
+    string getQuery(string msg, string params="", priority_t priority=PRIORITY_AUTO)
     {
-        if(query(msg, params))
-        {
-            return get();
-        }
-        else
-        {
-            return "";
-        }
+        return transaction(msg, params, "?", true, priority)->data;
     }
 
     bool setParam(string msg, string params="") {
@@ -89,14 +289,7 @@ public:
     }
 
     string getParam(string msg, string params="") {
-        if(query(msg, params, "~"))
-        {
-            return get();
-        }
-        else
-        {
-            return "";
-        }
+        return transaction(msg, params, "~", true, PRIORITY_AUTO)->data;
     }
 
     bool maintenance(string msg, string params="")
@@ -127,7 +320,7 @@ public:
     void reset()
     {
         // Send reset command
-        mSerial.write("%RESET 321654987");
+        mSerial->write("%RESET 321654987");
         // Wait one second after reset
         ros::Duration(1).sleep();
     }
@@ -198,41 +391,158 @@ public:
     /**
      * Template to connect a method in callback
      */
-    template <class T> bool addCallback(void(T::*fp)(const string), T* obj, const string data) {
+    template <class T> bool addCallback(void(T::*fp)(const boost::string_ref), T* obj, const string data) {
         return addCallback(bind(fp, obj, _1), data);
     }
 private:
-    // Serial port object
-    serial::Serial mSerial;
+    // Connection with the board: serial port, pty, TCP or loopback
+    std::unique_ptr<transport> mSerial;
     // Serial port name
     string mSerialPort;
     // Serial port baudrate
     uint32_t mBaudrate;
-    // Timeout open serial port
+    // Timeout of the reader wait, the reader wake up immediately on stop
     uint32_t mTimeout;
     // Used to stop the serial processing
-    bool mStopping;
-    // Last message sent
-    string mMessage;
+    std::atomic<bool> mStopping;
+    // Last data received from a query
     string sub_data;
-    bool sub_data_cmd;
-    bool data;
     // Async reader controller
     std::thread first;
-    // Mutex to sto concurent sending
-    mutex mWriteMutex;
+    // Receive ring buffer
+    line_framer mRx;
+    // Capture of the bytes exchanged
+    session_capture mCapture;
+    // Grant the serial port by priority class, keep the write order equal to the reply queue order
+    traffic_scheduler mScheduler;
+    // Mutex to protect the reply queue
     mutex mReaderMutex;
     std::condition_variable cv;
+    // Reply queue, all requests in flight in order of transmission
+    deque<request_ptr> mPending;
+    // Round trip time and status of the link, protected from the reply queue mutex
+    link_monitor mLink;
+    // Latency of each mnemonic, lock free
+    command_latency mLatency;
+    // Attempts of a transaction for each priority class
+    unsigned int mRetryBudget[PRIORITY_CLASSES];
+    // Wait a free place in the reply queue
+    std::condition_variable mWindow;
+    // Places of the reply queue reserved from the lines waiting the grant
+    size_t mReserved;
+    // Mnemonics repeated from the board in order
+    vector<string> mStream;
+    // Next mnemonic expected from the stream
+    size_t mStreamCursor;
     // Hashmap with all type of message
     map<string, callback_data_t> hashmap;
     // HLD mode - To download script - reference [pag. 183]
     bool isHLD;
     // Version script
     string _script_ver;
+    /**
+     * @brief newRequest Initialize a new request
+     * @param name The mnemonic expected in the reply, empty for commands
+     * @param mnemonic The mnemonic of the request packed with mnemonic_key()
+     * @return The request
+     */
+    request_ptr newRequest(string name, uint64_t mnemonic);
+    /**
+     * @brief resetRequest Prepare a request completed to be sent again
+     * @param request The request
+     * @param name The mnemonic expected in the reply, empty for commands
+     * @param mnemonic The mnemonic of the request packed with mnemonic_key()
+     */
+    void resetRequest(const request_ptr &request, const string &name, uint64_t mnemonic);
+    /**
+     * @brief transmit Add all requests in the reply queue and write the line
+     * @param requests The requests sent with the line
+     * @param line The line to write
+     * @param priority The priority class of the line
+     * @param attempt The attempt of the requests, the timeout is doubled for every attempt
+     */
+    void transmit(const vector<request_ptr> &requests, const string &line, priority_t priority, unsigned int attempt=0)
+    {
+        transmit(requests, line.data(), line.size(), priority, attempt);
+    }
+    /**
+     * @brief transmit Add all requests in the reply queue and write the line.
+     * The place in the reply queue is reserved before waiting the grant, the emergency stop
+     * is never held back. If the reply queue stay full the requests fail without writing
+     * @param requests The requests sent with the line
+     * @param line The line to write
+     * @param size The length of the line
+     * @param priority The priority class of the line
+     * @param attempt The attempt of the requests, the timeout is doubled for every attempt
+     */
+    void transmit(const vector<request_ptr> &requests, const char* line, size_t size, priority_t priority, unsigned int attempt=0);
+    /**
+     * @brief expire Remove a request without reply from the reply queue and update the status of the link
+     * @param request The request
+     */
+    void expire(const request_ptr &request);
+    /**
+     * @brief lost Update the status of the link with a request lost
+     * @param request The request
+     */
+    void lost(const request_ptr &request);
+    /**
+     * @brief classify Select the priority class of a message
+     * @param msg The message
+     * @param type The type of message
+     * @return The priority class
+     */
+    priority_t classify(const string &msg, const string &type);
+    /**
+     * @brief send Write a request and add it in the reply queue
+     * @param msg The message
+     * @param params The parameters
+     * @param type The type of message
+     * @param query true if the request wait a data
+     * @param priority The priority class
+     * @param attempt The attempt of the request
+     * @return The request in flight
+     */
+    request_ptr send(string msg, string params, string type, bool query, priority_t priority, unsigned int attempt=0);
+    /**
+     * @brief transaction Send a request and wait the reply, retry on timeout within the budget of the class
+     * @param msg The message
+     * @param params The parameters
+     * @param type The type of message
+     * @param query true if the request wait a data
+     * @param priority The priority class
+     * @return The last request sent
+     */
+    request_ptr transaction(string msg, string params, string type, bool query, priority_t priority);
+    /**
+     * @brief complete Close the first request in the reply queue waiting this reply.
+     * All requests sent before are closed as lost
+     * @param name The mnemonic of the reply, empty for '+' that close the oldest command and '-' that close the oldest request
+     * @param status The status of the reply
+     * @param data The data received
+     * @return true if a request waited this reply
+     */
+    bool complete(const boost::string_ref &name, bool status, const boost::string_ref &data);
+    /**
+     * @brief streamNext Check if the message is the next expected from the stream
+     * @param name The mnemonic of the message
+     * @return true if the message belong to the stream
+     */
+    bool streamNext(const boost::string_ref &name);
+    /**
+     * @brief dispatch Decode a line and send it to the request waiting or to the callbacks
+     * @param line The line received without the end of line
+     */
+    void dispatch(const boost::string_ref &line);
     /**
      * @brief async_reader Thread to read realtime all charachters sent from roboteq board
      */
     void async_reader();
+    /**
+     * @brief reconnect Close the serial port after an error and open it again until the stop
+     * @return true if the serial port is open again
+     */
+    bool reconnect();
     /**
      * @brief enableDownload Enable writing script
      * @return Status of HLD reference [pag. 183]
@@ -0,0 +1,223 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SESSION_CAPTURE_H
+#define SESSION_CAPTURE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <boost/utility/string_ref.hpp>
+
+#include "roboteq/mapped_file.h"
+
+namespace roboteq {
+
+/// Direction of the bytes captured
+typedef enum _capture_direction {
+    CAPTURE_TX = 0,
+    CAPTURE_RX = 1,
+    // Filler to the end of the ring
+    CAPTURE_PAD = 0xFFFF,
+} capture_direction_t;
+
+/// Record in the capture file, followed from the payload and aligned to 8 bytes
+typedef struct _capture_record {
+    // Length of the payload
+    uint32_t length;
+    // capture_direction_t
+    uint16_t direction;
+    uint16_t reserved;
+    // Monotonic time in ns
+    uint64_t stamp;
+} capture_record_t;
+
+/// Header of the capture file, followed from the ring of the records
+typedef struct _capture_header {
+    // "RQCAP01"
+    char magic[8];
+    // Size of the ring in bytes
+    uint64_t capacity;
+    // Absolute offset of the next record and of the oldest record in the ring
+    uint64_t head;
+    uint64_t tail;
+    // Records written and dropped because the writer is late
+    uint64_t records;
+    uint64_t dropped;
+    uint64_t reserved[2];
+} capture_header_t;
+
+/**
+ * @brief capture_record_size The size of a record in the file
+ * @param length The length of the payload
+ * @return The size aligned to 8 bytes
+ */
+inline size_t capture_record_size(size_t length)
+{
+    return (sizeof(capture_record_t) + length + 7) & ~static_cast<size_t>(7);
+}
+
+/**
+ * @brief The session_capture class Capture of all bytes exchanged with the board in a
+ * preallocated memory mapped ring file. The serial threads copy the chunks in a staging
+ * buffer, a background thread move them in the file. The file survive a crash of the driver,
+ * the oldest records are overwritten when the ring is full.
+ */
+class session_capture
+{
+public:
+    session_capture();
+    ~session_capture();
+    /**
+     * @brief start Create the capture file and start the writer
+     * @param path The file
+     * @param size The size of the ring in bytes
+     * @return false if the file is not created
+     */
+    bool start(const std::string &path, size_t size);
+    /**
+     * @brief stop Write the records pending and close the file
+     */
+    void stop();
+    /**
+     * @brief isEnabled The capture is running
+     */
+    bool isEnabled() const
+    {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief record Add a chunk of bytes, without system calls and allocations
+     * @param direction The direction
+     * @param data The bytes
+     * @param size The number of bytes
+     */
+    void record(capture_direction_t direction, const char* data, size_t size)
+    {
+        if(isEnabled())
+            push(direction, data, size);
+    }
+    /**
+     * @brief error The last error
+     */
+    const std::string &error() const
+    {
+        return mError;
+    }
+
+private:
+    /// Size of each staging buffer
+    static const size_t stage_size = 65536;
+    std::atomic<bool> mEnabled;
+    std::string mError;
+    // Double staging buffer, the serial threads fill the active one
+    std::mutex mStageMutex;
+    char mStage[2][stage_size];
+    size_t mStageUsed[2];
+    int mActive;
+    uint64_t mDropped;
+    // File mapped
+    mapped_file mFile;
+    capture_header_t* mHeader;
+    char* mRing;
+    // Background writer
+    std::thread mWriter;
+    std::atomic<bool> mRunning;
+
+    void push(capture_direction_t direction, const char* data, size_t size);
+    /**
+     * @brief flush Move the staging buffer in the ring
+     */
+    void flush();
+    /**
+     * @brief append Add a record in the ring, the oldest records are dropped
+     * @param record The record with the payload
+     */
+    void append(const capture_record_t* record);
+    /**
+     * @brief reclaim Drop the oldest records until the ring has space to the end offset
+     * @param end The absolute offset
+     */
+    void reclaim(uint64_t end);
+    void run();
+};
+
+/**
+ * @brief The capture_reader class Read the records of a capture file, from the oldest
+ */
+class capture_reader
+{
+public:
+    capture_reader();
+    ~capture_reader();
+    /**
+     * @brief open Map the capture file
+     * @param path The file
+     * @return false if the file is not a capture
+     */
+    bool open(const std::string &path);
+    void close();
+    /**
+     * @brief next The next record
+     * @param record The record
+     * @param payload The bytes, valid until close()
+     * @return false at the end of the capture
+     */
+    bool next(capture_record_t &record, boost::string_ref &payload);
+    /**
+     * @brief rewind Restart from the oldest record
+     */
+    void rewind();
+    /**
+     * @brief header The header of the file
+     */
+    const capture_header_t &header() const
+    {
+        return mHeaderCopy;
+    }
+    const std::string &error() const
+    {
+        return mError;
+    }
+
+private:
+    mapped_file mFile;
+    const char* mRing;
+    capture_header_t mHeaderCopy;
+    uint64_t mOffset;
+    std::string mError;
+};
+
+}
+
+#endif // SESSION_CAPTURE_H
@@ -0,0 +1,149 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <boost/utility/string_ref.hpp>
+
+namespace roboteq {
+
+/// Maximum number of channels in a Roboteq board
+const size_t max_channels = 3;
+
+/// Telemetry fields in the order of the queries
+typedef enum _telemetry_field {
+    FIELD_FLAGS = 0,        // FM <-> _MOTFLAG [pag. 246]
+    FIELD_COMMAND,          // M <-> _MOTCMD [pag. 250]
+    FIELD_FEEDBACK,         // F <-> _FEEDBK [pag. 244]
+    FIELD_LOOP_ERROR,       // E <-> _LPERR [pag. 243]
+    FIELD_POWER,            // P <-> _MOTPWR [pag. 255]
+    FIELD_VOLTS,            // V 2 <-> _VOLTS [pag. 262]
+    FIELD_AMPS,             // A <-> _MOTAMPS [pag. 230]
+    FIELD_BATTERY_AMPS,     // BA <-> _BATAMPS [pag. 233]
+    FIELD_COUNTER,          // C <-> _ABCNTR [pag. 236]
+    FIELD_TRACK,            // TR <-> _TR [pag. 260]
+    TELEMETRY_FIELDS
+} telemetry_field_t;
+
+/// Status of the decoding
+typedef enum _decode_status {
+    DECODE_OK = 0,
+    DECODE_EMPTY,           // No data received
+    DECODE_INVALID,         // Character not expected
+    DECODE_OVERFLOW,        // Value out of range
+    DECODE_MISSING          // Less channels than requested
+} decode_status_t;
+
+/// All fields of a channel read in a control loop
+typedef struct _motor_frame {
+    // Raw values from the board
+    int32_t value[TELEMETRY_FIELDS];
+    // Bit mask of the fields decoded
+    uint32_t valid;
+    // Monotonic time in ns when each field is received, zero never
+    uint64_t stamp[TELEMETRY_FIELDS];
+} motor_frame_t;
+
+/// Bit mask of a frame with all fields
+const uint32_t frame_complete = (1 << TELEMETRY_FIELDS) - 1;
+
+/// Query and parameters for each field
+extern const char* const telemetry_query[TELEMETRY_FIELDS][2];
+
+/**
+ * @brief parse_int Decode a signed integer and move the pointer after the last digit
+ * @param p The pointer to the first character, moved after the number
+ * @param end The end of the data
+ * @param value The value decoded
+ * @return The status of the decoding
+ */
+inline decode_status_t parse_int(const char* &p, const char* end, int32_t &value)
+{
+    if(p == end)
+        return DECODE_EMPTY;
+    bool negative = (*p == '-');
+    if(negative || *p == '+')
+        ++p;
+    if(p == end || *p < '0' || *p > '9')
+        return DECODE_INVALID;
+    int64_t number = 0;
+    while(p != end && *p >= '0' && *p <= '9')
+    {
+        number = number * 10 + (*p - '0');
+        if(number > 2147483648LL)
+            return DECODE_OVERFLOW;
+        ++p;
+    }
+    if(negative)
+        number = -number;
+    if(number > 2147483647LL)
+        return DECODE_OVERFLOW;
+    value = static_cast<int32_t>(number);
+    return DECODE_OK;
+}
+
+/**
+ * @brief decode_field Decode the reply of a telemetry query "v1:v2:..." in the frames of all channels.
+ * The voltage is one value for all channels
+ * @param field The field decoded
+ * @param data The data of the reply
+ * @param frames The frames, one for each channel
+ * @param channels Number of channels to decode
+ * @return The status of the decoding
+ */
+decode_status_t decode_field(telemetry_field_t field, const boost::string_ref &data, motor_frame_t *frames, size_t channels);
+
+/**
+ * @brief decode_value Decode the reply of a query with a single value
+ * @param data The data of the reply
+ * @param value The value decoded
+ * @return The status of the decoding
+ */
+decode_status_t decode_value(const boost::string_ref &data, int32_t &value);
+
+/**
+ * @brief clear_frames Reset all frames before a new decoding
+ * @param frames The frames
+ * @param channels Number of channels
+ */
+inline void clear_frames(motor_frame_t *frames, size_t channels)
+{
+    for(size_t i = 0; i < channels; ++i)
+    {
+        frames[i].valid = 0;
+    }
+}
+
+}
+
+#endif // TELEMETRY_H
@@ -0,0 +1,272 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TELEMETRY_ARCHIVE_H
+#define TELEMETRY_ARCHIVE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "roboteq/mapped_file.h"
+#include "roboteq/telemetry.h"
+
+namespace roboteq {
+
+/// Rows of a chunk, about 20s of a channel at 50Hz
+const size_t archive_rows = 1024;
+
+/// Columns of a chunk, the time and the mask before the telemetry fields
+typedef enum _archive_column_id {
+    COLUMN_TIME = 0,        // Wall time in us
+    COLUMN_VALID,           // Bit mask of the fields decoded
+    COLUMN_FIELDS,          // First telemetry field, as telemetry_field_t
+    ARCHIVE_COLUMNS = COLUMN_FIELDS + TELEMETRY_FIELDS
+} archive_column_id_t;
+
+/// Encoding of a column
+typedef enum _archive_encoding {
+    ENCODING_DELTA = 0,     // First value and differences, zig-zag varint
+    ENCODING_RLE = 1,       // Pairs of value and run length, zig-zag varint
+} archive_encoding_t;
+
+/// Header of the archive file, followed from the chunks
+typedef struct _archive_header {
+    // "RQARC01"
+    char magic[8];
+    // Number of telemetry fields of each row
+    uint32_t fields;
+    uint32_t reserved;
+} archive_header_t;
+
+/// Position of a column in the chunk
+typedef struct _archive_column {
+    // Offset from the start of the chunk and size in bytes
+    uint32_t offset;
+    uint32_t size;
+    // archive_encoding_t
+    uint32_t encoding;
+    uint32_t reserved;
+} archive_column_t;
+
+/// Header of a chunk of rows of a channel, followed from the columns. The chunks are aligned to 8 bytes
+typedef struct _archive_chunk {
+    // "RQCH"
+    char magic[4];
+    // Size of the chunk with the header and the columns
+    uint32_t size;
+    uint32_t rows;
+    // Channel, from zero
+    uint16_t channel;
+    uint16_t columns;
+    // Wall time in us of the first and of the last row
+    int64_t first;
+    int64_t last;
+    // Range of each field in the rows where it is decoded, to answer without decode the columns
+    int32_t min[TELEMETRY_FIELDS];
+    int32_t max[TELEMETRY_FIELDS];
+    archive_column_t column[ARCHIVE_COLUMNS];
+} archive_chunk_t;
+
+/// A run of the same value in a column
+typedef struct _archive_run {
+    int64_t value;
+    uint32_t length;
+} archive_run_t;
+
+/**
+ * @brief The archive_writer class Archive of the frames of all channels in column chunks.
+ * The control loop fill the rows of a block without locks and system calls, a background
+ * thread encode the blocks full and append them to the file
+ */
+class archive_writer
+{
+public:
+    archive_writer();
+    ~archive_writer();
+    /**
+     * @brief start Open the archive, a file already there is extended
+     * @param path The file
+     * @return false if the file is not opened
+     */
+    bool start(const std::string &path);
+    /**
+     * @brief stop Write the rows pending and close the file
+     */
+    void stop();
+    bool isEnabled() const
+    {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief append Add a row if the frame is new, only from one thread
+     * @param channel The channel, from zero
+     * @param frame The frame decoded
+     */
+    void append(size_t channel, const motor_frame_t &frame)
+    {
+        if(isEnabled() && channel < max_channels)
+            push(channel, frame);
+    }
+    /**
+     * @brief setWallOffset Change the conversion of the stamps, to archive the frames of another run
+     * @param offset Wall time minus monotonic time in ns
+     */
+    void setWallOffset(int64_t offset)
+    {
+        mWallOffset = offset;
+    }
+    /**
+     * @brief sync Wait the writer to write all blocks full, for the offline tools
+     */
+    void sync();
+    /**
+     * @brief dropped Rows lost because the background writer is late
+     */
+    uint64_t dropped() const
+    {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+    const std::string &error() const
+    {
+        return mError;
+    }
+
+private:
+    /// Rows of a channel in columns, before the encoding
+    typedef struct _archive_block {
+        size_t rows;
+        int64_t time[archive_rows];
+        uint32_t valid[archive_rows];
+        int32_t value[TELEMETRY_FIELDS][archive_rows];
+        // Full and waiting the writer
+        std::atomic<bool> ready;
+    } archive_block_t;
+
+    std::atomic<bool> mEnabled;
+    std::string mError;
+    int mFd;
+    // Wall time minus monotonic time in ns
+    int64_t mWallOffset;
+    // Two blocks for each channel, the control loop fill the active one
+    std::unique_ptr<archive_block_t[]> mBlocks;
+    int mActive[max_channels];
+    // Stamp of the last frame of each channel
+    uint64_t mLast[max_channels];
+    std::atomic<uint64_t> mDropped;
+    // Background writer
+    std::thread mWriter;
+    std::atomic<bool> mRunning;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    // Chunk in encoding
+    std::vector<char> mChunk;
+
+    void push(size_t channel, const motor_frame_t &frame);
+    void run();
+    /**
+     * @brief flush Encode and write the blocks ready
+     * @param partial Also the blocks not full
+     */
+    void flush(bool partial);
+    /**
+     * @brief write Encode a block in a chunk and append it to the file
+     * @param channel The channel
+     * @param block The block
+     */
+    void write(size_t channel, const archive_block_t &block);
+};
+
+/**
+ * @brief The archive_reader class Map an archive and decode only the columns required
+ */
+class archive_reader
+{
+public:
+    archive_reader();
+    /**
+     * @brief open Map the archive
+     * @param path The file
+     * @return false if the file is not an archive
+     */
+    bool open(const std::string &path);
+    void close();
+    /**
+     * @brief next The next chunk, a chunk truncated from a crash end the archive
+     * @return The chunk in the file, NULL at the end
+     */
+    const archive_chunk_t* next();
+    /**
+     * @brief rewind Restart from the first chunk
+     */
+    void rewind();
+    /**
+     * @brief decode Decode all values of a column
+     * @param chunk The chunk
+     * @param column The column
+     * @param values The values, one for each row
+     * @return false if the column is corrupted
+     */
+    bool decode(const archive_chunk_t *chunk, archive_column_id_t column, std::vector<int64_t> &values) const;
+    /**
+     * @brief runs The runs of a column, without expand them
+     * @param chunk The chunk
+     * @param column The column, RLE encoded
+     * @param runs The runs
+     * @return false if the column is not RLE or corrupted
+     */
+    bool runs(const archive_chunk_t *chunk, archive_column_id_t column, std::vector<archive_run_t> &runs) const;
+    /**
+     * @brief size Size of the archive in bytes
+     */
+    size_t size() const
+    {
+        return mFile.size();
+    }
+    const std::string &error() const
+    {
+        return mError;
+    }
+
+private:
+    mapped_file mFile;
+    size_t mOffset;
+    std::string mError;
+};
+
+}
+
+#endif // TELEMETRY_ARCHIVE_H
@@ -0,0 +1,153 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+// Static probe roboteq:<event>, a nop until a tracer attach it (perf, bpftrace, systemtap)
+#define ROBOTEQ_PROBE(event, arg, id) DTRACE_PROBE2(roboteq, event, arg, id)
+#else
+#define ROBOTEQ_PROBE(event, arg, id) do {} while(0)
+#endif
+
+/**
+ * Trace an event of the serial transactions or of the control cycle.
+ * The static probe is always there, the recorder only when started.
+ * @param event The name of the event, one of trace_event_t without prefix
+ * @param arg The argument of the event
+ * @param id The object of the event, the request for the serial transactions
+ */
+#define ROBOTEQ_TRACE(event, arg, id) do { \
+        ROBOTEQ_PROBE(event, arg, id); \
+        if(roboteq::trace_recorder::enabled()) \
+            roboteq::trace_recorder::instance().record(roboteq::TRACE_##event, (arg), (id)); \
+    } while(0)
+
+namespace roboteq {
+
+/// Events traced
+typedef enum _trace_event {
+    TRACE_enqueue,          // Request in the reply queue, arg mnemonic
+    TRACE_write,            // Line written, arg bytes
+    TRACE_rx_first,         // First bytes of a new line read, arg bytes
+    TRACE_line,             // Line complete, arg length
+    TRACE_complete,         // Reply matched with the request, arg mnemonic
+    TRACE_lost,             // Request closed without reply, arg mnemonic
+    TRACE_dispatch,         // Callback of a message not requested, arg mnemonic
+    TRACE_wakeup,           // Waiter woken up with the request closed, arg mnemonic
+    TRACE_phase_begin,      // Start of a phase of the control cycle, arg phase
+    TRACE_phase_end,        // End of a phase of the control cycle, arg phase
+    TRACE_EVENTS
+} trace_event_t;
+
+/// An event in the recorder
+typedef struct _trace_record {
+    // Monotonic time in ns
+    uint64_t stamp;
+    uint64_t arg;
+    uint64_t id;
+    // Thread of the event
+    uint32_t tid;
+    uint32_t event;
+} trace_record_t;
+
+/**
+ * @brief The trace_recorder class Ring of the last events traced, written lock free from all threads
+ * and exported as a Chrome/Perfetto JSON timeline
+ */
+class trace_recorder
+{
+public:
+    /**
+     * @brief instance The recorder of the process
+     * @return The recorder
+     */
+    static trace_recorder& instance();
+    /**
+     * @brief enabled Check if the recorder is started, a relaxed load in the hot paths
+     * @return True if the events are recorded
+     */
+    static bool enabled()
+    {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief start Clear the ring and start to record
+     * @param capacity Number of events kept, rounded to a power of two
+     */
+    void start(size_t capacity);
+    /**
+     * @brief stop Stop to record and wait the writers in flight, the events are kept until the next start
+     */
+    void stop();
+    /**
+     * @brief record Add an event, lock free
+     * @param event The event
+     * @param arg The argument of the event
+     * @param id The object of the event
+     */
+    void record(trace_event_t event, uint64_t arg, uint64_t id);
+    /**
+     * @brief save Write the events in the Chrome trace event format, open with chrome://tracing or ui.perfetto.dev
+     * @param path The JSON file
+     * @return The number of events saved, -1 on error
+     */
+    long save(const std::string &path) const;
+
+private:
+    trace_recorder();
+
+    /// A slot of the ring, the sequence is the index of the event plus one when stable
+    typedef struct _trace_slot {
+        std::atomic<uint64_t> sequence;
+        trace_record_t record;
+    } trace_slot_t;
+
+    // Recorder started
+    static std::atomic<bool> _enabled;
+    // Ring of the events
+    std::unique_ptr<trace_slot_t[]> _ring;
+    size_t _mask;
+    // Index of the next event
+    std::atomic<uint64_t> _head;
+    // Writers inside record(), stop() waits them before the ring is read or reallocated
+    std::atomic<unsigned int> _writers;
+};
+
+}
+
+#endif // TRACE_RECORDER_H
@@ -0,0 +1,154 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRAFFIC_SCHEDULER_H
+#define TRAFFIC_SCHEDULER_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+
+namespace roboteq {
+
+/// Priority classes of the serial traffic, from the most important
+typedef enum _priority {
+    PRIORITY_ESTOP,         // Emergency stop and release, never waits a share
+    PRIORITY_COMMAND,       // Motor commands of the control loop
+    PRIORITY_FEEDBACK,      // Telemetry of the control loop
+    PRIORITY_DIAGNOSTIC,    // Diagnostic and GPIO status
+    PRIORITY_CONFIG,        // Parameters and maintenance
+    PRIORITY_CLASSES,
+    PRIORITY_AUTO = PRIORITY_CLASSES   // Select the class from the message
+} priority_t;
+
+/// Statistics of a priority class
+typedef struct _class_stats {
+    // Lines waiting the serial port now
+    size_t depth;
+    // Maximum lines waiting the serial port
+    size_t max_depth;
+    // Lines transmitted
+    uint64_t lines;
+    // Bytes transmitted
+    uint64_t bytes;
+    // Wait before the transmission in us
+    double wait_mean;
+    double wait_max;
+} class_stats_t;
+
+/**
+ * @brief priority_name The name of the priority class
+ * @param priority The priority class
+ * @return The name
+ */
+const char* priority_name(priority_t priority);
+
+/**
+ * @brief The traffic_scheduler class Grant the serial port to one line at time.
+ * The line of the highest class with bandwidth available is granted first, when all classes
+ * waiting have exhausted their share the highest class is granted anyway.
+ * The emergency stop is granted before all other classes. A line already granted is never interrupted.
+ */
+class traffic_scheduler
+{
+public:
+    /**
+     * @brief traffic_scheduler Initialize the scheduler
+     * @param baudrate The baudrate of the serial port, used to refill the shares
+     */
+    explicit traffic_scheduler(unsigned long baudrate);
+    /**
+     * @brief setShare Set the fraction of the bandwidth reserved to a class
+     * @param priority The priority class
+     * @param share The fraction of the bandwidth [0, 1]
+     */
+    void setShare(priority_t priority, double share);
+    /**
+     * @brief acquire Wait the serial port
+     * @param priority The priority class of the line
+     * @param bytes The size of the line
+     */
+    void acquire(priority_t priority, size_t bytes);
+    /**
+     * @brief release Free the serial port and grant the next line
+     */
+    void release();
+    /**
+     * @brief getStats The statistics of a priority class
+     * @param priority The priority class
+     * @return The statistics
+     */
+    class_stats_t getStats(priority_t priority);
+
+private:
+    typedef std::chrono::steady_clock clock_t;
+    /// Line waiting the serial port
+    typedef struct _ticket {
+        uint64_t id;
+        size_t bytes;
+    } ticket_t;
+
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    // Bytes per second of the serial port
+    double mRate;
+    // The serial port is in use
+    bool mBusy;
+    // Ticket granted, the owner can take the serial port
+    uint64_t mGranted;
+    bool mHasGrant;
+    // Next ticket id
+    uint64_t mNext;
+    // Lines waiting for each class in order of arrival
+    std::deque<ticket_t> mQueue[PRIORITY_CLASSES];
+    // Fraction of the bandwidth of each class
+    double mShare[PRIORITY_CLASSES];
+    // Bytes available for each class
+    double mTokens[PRIORITY_CLASSES];
+    // Last refill of the shares
+    clock_t::time_point mRefill;
+    // Statistics
+    class_stats_t mStats[PRIORITY_CLASSES];
+    /**
+     * @brief refill Add the bytes of the shares for the time elapsed
+     */
+    void refill();
+    /**
+     * @brief grantNext Grant the serial port to the next line waiting
+     */
+    void grantNext();
+};
+
+}
+
+#endif // TRAFFIC_SCHEDULER_H
@@ -0,0 +1,257 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <cstddef>
+#include <string>
+#include <sys/uio.h>
+
+namespace roboteq {
+
+/**
+ * @brief The transport class Byte stream between the driver and a Roboteq board
+ */
+class transport
+{
+public:
+    virtual ~transport() {}
+    /**
+     * @brief open Open the connection, nothing if already open
+     * @return true if open
+     */
+    virtual bool open() = 0;
+    /**
+     * @brief close Close the connection
+     */
+    virtual void close() = 0;
+    /**
+     * @brief isOpen The connection is open
+     * @return true if open
+     */
+    virtual bool isOpen() const = 0;
+    /**
+     * @brief read Wait and read the bytes available
+     * @param buffer The buffer
+     * @param size The size of the buffer
+     * @param timeout The timeout in ms, negative wait forever
+     * @return The bytes read, zero on timeout or interrupt, negative on error
+     */
+    virtual long read(char* buffer, size_t size, int timeout) = 0;
+    /**
+     * @brief write Write all bytes
+     * @param data The bytes
+     * @param size The number of bytes
+     * @return true if all bytes are written
+     */
+    virtual bool write(const char* data, size_t size) = 0;
+    /**
+     * @brief writev Write all buffers with a single call
+     * @param iov The buffers
+     * @param count The number of buffers
+     * @return true if all bytes are written
+     */
+    virtual bool writev(const struct iovec* iov, int count) = 0;
+    /**
+     * @brief setLineRate The speed of the line, bound the wait of a write with the output buffer full
+     * @param baudrate The baudrate
+     */
+    virtual void setLineRate(unsigned long baudrate) = 0;
+    /**
+     * @brief interrupt Wake up the reader blocked in read()
+     */
+    virtual void interrupt() = 0;
+    /**
+     * @brief error The description of the last error
+     * @return The error
+     */
+    virtual const std::string &error() const = 0;
+    /**
+     * @brief write Write a string
+     * @param data The string
+     * @return true if all bytes are written
+     */
+    bool write(const std::string &data)
+    {
+        return write(data.data(), data.size());
+    }
+};
+
+/**
+ * @brief The fd_transport class Transport on a file descriptor: non blocking reads driven
+ * from epoll and an eventfd to wake up the reader. Adopt a descriptor already open
+ */
+class fd_transport : public transport
+{
+public:
+    /**
+     * @brief fd_transport Adopt a descriptor, closed with the transport
+     * @param fd The descriptor, negative if opened from a backend
+     */
+    explicit fd_transport(int fd = -1);
+
+    virtual ~fd_transport();
+
+    virtual bool open();
+
+    virtual void close();
+
+    virtual bool isOpen() const
+    {
+        return mFd >= 0;
+    }
+
+    virtual long read(char* buffer, size_t size, int timeout);
+
+    virtual bool write(const char* data, size_t size);
+
+    virtual bool writev(const struct iovec* iov, int count);
+
+    virtual void setLineRate(unsigned long baudrate)
+    {
+        mLineRate = baudrate;
+    }
+
+    virtual void interrupt();
+
+    virtual const std::string &error() const
+    {
+        return mError;
+    }
+
+    using transport::write;
+
+protected:
+    // File descriptor of the connection
+    int mFd;
+    // epoll waiting the connection and the shutdown
+    int mEpoll;
+    // Event to wake up the reader
+    int mEvent;
+    // Speed of the line in baud
+    unsigned long mLineRate;
+    // Last error
+    std::string mError;
+    /**
+     * @brief attach Prepare the descriptor for non blocking reads and the wait with epoll
+     * @param fd The descriptor
+     * @return true if ready
+     */
+    bool attach(int fd);
+    /**
+     * @brief fail Save the last error and close all descriptors
+     * @param what The operation failed
+     * @return false
+     */
+    bool fail(const std::string &what);
+};
+
+/**
+ * @brief The pty_transport class Master side of a new pseudo terminal.
+ * A board emulator open the slave side as a serial port
+ */
+class pty_transport : public fd_transport
+{
+public:
+    pty_transport();
+
+    virtual bool open();
+
+    virtual void close();
+    /**
+     * @brief slaveName The device of the slave side
+     * @return The device
+     */
+    const std::string &slaveName() const
+    {
+        return mSlaveName;
+    }
+
+private:
+    // The slave side kept open, the master receive a hang up without any slave
+    int mSlave;
+    std::string mSlaveName;
+};
+
+/**
+ * @brief The tcp_transport class TCP connection to a serial gateway like ser2net
+ */
+class tcp_transport : public fd_transport
+{
+public:
+    /**
+     * @brief tcp_transport Set the gateway
+     * @param host The host
+     * @param port The TCP port
+     */
+    tcp_transport(const std::string &host, const std::string &port);
+
+    virtual bool open();
+
+private:
+    std::string mHost;
+    std::string mPort;
+};
+
+/**
+ * @brief The loopback_transport class In process connection, the other side is taken with takePeer()
+ */
+class loopback_transport : public fd_transport
+{
+public:
+    loopback_transport();
+
+    virtual ~loopback_transport();
+
+    virtual bool open();
+    /**
+     * @brief takePeer The other side of the connection, the caller own the transport
+     * @return The other side, NULL if not open
+     */
+    fd_transport* takePeer();
+
+private:
+    // Other side of the connection until taken
+    int mPeer;
+};
+
+/**
+ * @brief make_transport Create the transport from an address:
+ * "tcp://host:port", "pty://", "loopback://" or the device of a serial port
+ * @param address The address
+ * @param baudrate The baudrate of a serial port
+ * @return The transport, not open
+ */
+transport* make_transport(const std::string &address, unsigned long baudrate);
+
+}
+
+#endif // TRANSPORT_H
@@ -0,0 +1,162 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TX_BUFFER_H
+#define TX_BUFFER_H
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+namespace roboteq {
+
+/**
+ * @brief The tx_buffer class Fixed size buffer to format many commands in a single line
+ * "!G 1 100_!G 2 -100\r" without allocations [pag. 179]
+ */
+class tx_buffer
+{
+public:
+    /// Maximum length of a line
+    static const size_t capacity = 256;
+
+    tx_buffer()
+        : mSize(0)
+        , mCount(0)
+        , mOverflow(false)
+    {
+    }
+    /**
+     * @brief clear Remove all commands
+     */
+    void clear()
+    {
+        mSize = 0;
+        mCount = 0;
+        mOverflow = false;
+    }
+    /**
+     * @brief command Start a new command in the line
+     * @param type The type of command "!", "?", "^"
+     * @param name The mnemonic
+     */
+    void command(const char* type, const char* name)
+    {
+        if(mCount > 0)
+            put('_');
+        puts(type);
+        puts(name);
+        mCount++;
+    }
+    /**
+     * @brief argument Add an integer argument to the last command
+     * @param value The argument
+     */
+    void argument(int32_t value)
+    {
+        put(' ');
+        char digits[12];
+        size_t n = 0;
+        // Work in negative to format also the minimum value
+        int32_t number = (value < 0) ? value : -value;
+        do
+        {
+            digits[n++] = '0' - (number % 10);
+            number /= 10;
+        } while(number != 0);
+        if(value < 0)
+            put('-');
+        while(n > 0)
+            put(digits[--n]);
+    }
+    /**
+     * @brief finish Close the line with the end of line
+     */
+    void finish()
+    {
+        put('\r');
+    }
+    /**
+     * @brief data The line formatted
+     * @return The pointer to the first character
+     */
+    const char* data() const
+    {
+        return mData;
+    }
+    /**
+     * @brief size The length of the line
+     * @return The length
+     */
+    size_t size() const
+    {
+        return mSize;
+    }
+    /**
+     * @brief count Number of commands in the line
+     * @return The number of commands
+     */
+    size_t count() const
+    {
+        return mCount;
+    }
+    /**
+     * @brief overflow The line is longer than the buffer
+     * @return true if some characters are lost
+     */
+    bool overflow() const
+    {
+        return mOverflow;
+    }
+
+private:
+    char mData[capacity];
+    size_t mSize;
+    size_t mCount;
+    bool mOverflow;
+
+    void put(char c)
+    {
+        if(mSize < capacity)
+            mData[mSize++] = c;
+        else
+            mOverflow = true;
+    }
+
+    void puts(const char* s)
+    {
+        while(*s)
+            put(*s++);
+    }
+};
+
+}
+
+#endif // TX_BUFFER_H
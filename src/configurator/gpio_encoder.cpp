@@ -43,6 +43,9 @@ GPIOEncoderConfigurator::GPIOEncoderConfigurator(const ros::NodeHandle &nh, robo
     mNumber = number;
     // Set false on first run
     setup_encoder = false;
+    // Default encoder after gears
+    _reduction = 0;
+    _position = 0;
 }
 
 void GPIOEncoderConfigurator::initConfigurator(bool load_from_board)
@@ -62,21 +65,21 @@ void GPIOEncoderConfigurator::initConfigurator(bool load_from_board)
     // Get PPR Encoder parameter
     double ppr;
     nh_.getParam(mName + "/PPR", ppr);
-    _reduction = ppr;
     // Multiply for quadrature
-    _reduction *= 4;
-}
-
-double GPIOEncoderConfigurator::getConversion(double reduction) {
-    // Check if exist ratio variable
+    _reduction = ppr * 4;
+    // Get position encoder
+    int position = 0;
     if(nh_.hasParam(mName + "/position"))
     {
-        int position;
         nh_.getParam(mName + "/position", position);
-        // Read position if before (1) multiply with ratio
-        if(position) {
-            return _reduction * reduction;
-        }
+    }
+    _position = position;
+}
+
+double GPIOEncoderConfigurator::getConversion(double reduction) {
+    // Read position if before (1) multiply with ratio
+    if(_position) {
+        return _reduction * reduction;
     }
     return _reduction;
 }
@@ -243,6 +246,8 @@ void GPIOEncoderConfigurator::reconfigureCBEncoder(roboteq_control::RoboteqEncod
         mSerial->setParam("EHOME", std::to_string(mNumber) + " " + std::to_string(config.encoder_home_count));
     }
 
+    // Update position encoder
+    _position = config.position;
     // Update last configuration
     _last_encoder_config = config;
 
@@ -40,6 +40,9 @@ MotorParamConfigurator::MotorParamConfigurator(const ros::NodeHandle& nh, robote
     mNumber = number;
     // Set false on first run
     setup_param = false;
+    // Default parameters
+    _ratio = 1.0;
+    _max_speed = 0.0;
 }
 
 void MotorParamConfigurator::initConfigurator(bool load_from_board)
@@ -60,6 +63,7 @@ void MotorParamConfigurator::initConfigurator(bool load_from_board)
         // Send alter ratio value
         ROS_WARN_STREAM("Default Ratio is " << ratio);
     }
+    _ratio = ratio;
 
     // Check if is required load paramers
     if(load_from_board)
@@ -168,6 +172,7 @@ void MotorParamConfigurator::getParamFromRoboteq()
         double max_rpm = ((double) rpm_motor) / ratio;
         // Set parameter
         nh_.setParam(mName + "/max_speed", max_rpm);
+        _max_speed = max_rpm;
 
         // Get Max RPM acceleration rate
         string str_rpm_acceleration_motor = mSerial->getParam("MAC", std::to_string(mNumber));
@@ -202,6 +207,9 @@ void MotorParamConfigurator::reconfigureCBParam(roboteq_control::RoboteqParamete
       _last_param_config = config;
       default_param_config = _last_param_config;
       setup_param = true;
+      // Initialize the parameters used in the control loop
+      _ratio = config.ratio;
+      _max_speed = config.max_speed;
       return;
     }
 
@@ -304,6 +312,9 @@ void MotorParamConfigurator::reconfigureCBParam(roboteq_control::RoboteqParamete
         mSerial->setParam("MDEC", std::to_string(mNumber) + " " + std::to_string(max_deceleration_motor));
     }
 
+    // Update the parameters used in the control loop
+    _ratio = config.ratio;
+    _max_speed = config.max_speed;
     // Update last configuration
     _last_param_config = config;
 }
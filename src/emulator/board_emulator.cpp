@@ -0,0 +1,414 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "emulator/board_emulator.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+namespace emulator {
+
+// Time constant of the motor model in seconds
+const double motor_tau(0.1);
+// Maximum queries in the history buffer
+const size_t max_history(16);
+// Parameters of the board, the others are of the channels
+const char* const board_params[] = {"ECHOF", "RWD", "BKD", "MXMD", "PWMF", "OVL", "UVL", "THLD", "CPRI", "SCRO", NULL};
+
+/**
+ * @brief is_board_param The parameter is of the board
+ * @param name The parameter
+ * @return true if of the board
+ */
+static bool is_board_param(const std::string &name)
+{
+    for(size_t i = 0; board_params[i] != NULL; ++i)
+    {
+        if(name.compare(board_params[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief parse_args Decode the integer arguments separated with spaces or ":"
+ * @param text The arguments
+ * @param args The values
+ */
+static void parse_args(const boost::string_ref &text, std::vector<int32_t> &args)
+{
+    args.clear();
+    std::string copy(text.data(), text.size());
+    const char* p = copy.c_str();
+    while(*p)
+    {
+        while(*p == ' ' || *p == ':') ++p;
+        if(!*p) break;
+        char* end;
+        double value = strtod(p, &end);
+        if(end == p)
+            break;
+        args.push_back(static_cast<int32_t>(value));
+        p = end;
+    }
+}
+
+board_emulator::board_emulator(size_t channels)
+    : mChannels(std::min(std::max(channels, (size_t) 1), max_channels))
+    , mRepeat(0)
+    , mEmergency(false)
+    , mLastUpdate(clock_t::now())
+    , mLastCommand(clock_t::now())
+{
+    for(size_t i = 0; i < max_channels; ++i)
+    {
+        mMotor[i].command = 0;
+        mMotor[i].speed = 0;
+        mMotor[i].counter = 0;
+    }
+    // Default of a new board
+    setParam("ECHOF", 0, 0);
+    setParam("RWD", 0, 1000);
+    for(size_t ch = 1; ch <= mChannels; ++ch)
+    {
+        setParam("MMOD", ch, 1);
+        setParam("MXRPM", ch, 3000);
+        setParam("EPPR", ch, 1024);
+        setParam("KP", ch, 20);
+        setParam("KI", ch, 10);
+        setParam("KD", ch, 0);
+    }
+}
+
+int32_t board_emulator::param(const std::string &name, size_t channel)
+{
+    std::map<std::string, std::vector<int32_t> >::iterator it = mParams.find(name);
+    if(it == mParams.end() || channel >= it->second.size())
+        return 0;
+    return it->second[channel];
+}
+
+void board_emulator::setParam(const std::string &name, size_t channel, int32_t value)
+{
+    std::vector<int32_t> &values = mParams[name];
+    if(values.size() < mChannels + 1)
+        values.resize(mChannels + 1, 0);
+    if(channel <= mChannels)
+        values[channel] = value;
+}
+
+void board_emulator::update()
+{
+    clock_t::time_point now = clock_t::now();
+    double dt = std::chrono::duration<double>(now - mLastUpdate).count();
+    mLastUpdate = now;
+    // Serial watchdog, the motors stop without commands [pag. 330]
+    int32_t watchdog = param("RWD", 0);
+    bool expired = watchdog > 0 && (now - mLastCommand) > std::chrono::milliseconds(watchdog);
+    for(size_t i = 0; i < mChannels; ++i)
+    {
+        motor_model_t &motor = mMotor[i];
+        if(expired || mEmergency)
+            motor.command = 0;
+        double max_rpm = std::max(param("MXRPM", i + 1), 1);
+        double target = motor.command / 1000.0 * max_rpm;
+        motor.speed += (target - motor.speed) * std::min(1.0, dt / motor_tau);
+        // Quadrature counter, 4 counts for each pulse
+        motor.counter += motor.speed / 60.0 * param("EPPR", i + 1) * 4.0 * dt;
+    }
+}
+
+bool board_emulator::channelValue(const std::string &name, size_t channel, int32_t &value)
+{
+    const motor_model_t &motor = mMotor[channel - 1];
+    double max_rpm = std::max(param("MXRPM", channel), 1);
+    double relative = motor.speed / max_rpm * 1000.0;
+    if(name == "FM") value = 0;
+    else if(name == "M") value = motor.command;
+    else if(name == "F") value = static_cast<int32_t>(relative);
+    else if(name == "E") value = static_cast<int32_t>(motor.command - relative);
+    else if(name == "P") value = motor.command;
+    else if(name == "A") value = static_cast<int32_t>(std::fabs(relative) / 20.0);
+    else if(name == "BA") value = static_cast<int32_t>(std::fabs(relative) * std::abs(motor.command) / 20000.0);
+    else if(name == "C" || name == "TR") value = static_cast<int32_t>(motor.counter);
+    else return false;
+    return true;
+}
+
+bool board_emulator::query(const std::string &name, const std::vector<int32_t> &args, std::string &out)
+{
+    int32_t value;
+    // Values of the board
+    if(name == "V")
+    {
+        // Internal, battery and 5V [pag. 262]
+        const int32_t volts[3] = {120, 240, 5000};
+        if(!args.empty())
+        {
+            size_t idx = std::min(std::max(args[0], 1), 3) - 1;
+            out += "V=" + std::to_string(volts[idx]);
+        }
+        else
+        {
+            out += "V=120:240:5000";
+        }
+        return true;
+    }
+    if(name == "T")
+    {
+        // MCU and bridges [pag. 259]
+        if(!args.empty())
+            out += "T=" + std::to_string(args[0] == 1 ? 35 : 30);
+        else
+            out += "T=35:30:30";
+        return true;
+    }
+    if(name == "FF") { out += "FF=" + std::to_string(mEmergency ? 16 : 0); return true; }
+    if(name == "FS") { out += "FS=1"; return true; }
+    if(name == "PI") { out += "PI=0:0:0:0:0:0"; return true; }
+    if(name == "AI") { out += "AI=0:0:0:0:0:0"; return true; }
+    if(name == "DI") { out += "DI=0:0:0:0:0:0"; return true; }
+    if(name == "DO") { out += "DO=" + std::to_string(param("DO", 0)); return true; }
+    if(name == "TRN") { out += "TRN=SDC2XXX:SDC2160"; return true; }
+    if(name == "FID") { out += "FID=Roboteq v1.8 SDC2XXX 07/07/2017 (emulator)"; return true; }
+    if(name == "UID") { out += "UID=1:2:3"; return true; }
+    if(name == "VAR") { out += "VAR=0"; return true; }
+    // Values of the channels
+    if(!channelValue(name, 1, value))
+        return false;
+    out += name + "=";
+    if(!args.empty())
+    {
+        if(args[0] < 1 || (size_t) args[0] > mChannels)
+            return false;
+        channelValue(name, args[0], value);
+        out += std::to_string(value);
+        return true;
+    }
+    for(size_t ch = 1; ch <= mChannels; ++ch)
+    {
+        channelValue(name, ch, value);
+        if(ch > 1) out += ":";
+        out += std::to_string(value);
+    }
+    return true;
+}
+
+bool board_emulator::command(const std::string &name, const std::vector<int32_t> &args)
+{
+    if(name == "G" || name == "S" || name == "P")
+    {
+        // Motor command [pag. 222]
+        if(args.size() < 2 || args[0] < 1 || (size_t) args[0] > mChannels)
+            return false;
+        mLastCommand = clock_t::now();
+        if(!mEmergency)
+            mMotor[args[0] - 1].command = std::min(std::max(args[1], -1000), 1000);
+        return true;
+    }
+    if(name == "M")
+    {
+        // Command of all channels [pag. 217]
+        if(args.empty())
+            return false;
+        mLastCommand = clock_t::now();
+        for(size_t i = 0; i < args.size() && i < mChannels && !mEmergency; ++i)
+            mMotor[i].command = std::min(std::max(args[i], -1000), 1000);
+        return true;
+    }
+    if(name == "MS")
+    {
+        for(size_t i = 0; i < mChannels; ++i)
+            if(args.empty() || (size_t) args[0] == i + 1)
+                mMotor[i].command = 0;
+        return true;
+    }
+    if(name == "EX") { mEmergency = true; return true; }
+    if(name == "MG") { mEmergency = false; return true; }
+    if(name == "C")
+    {
+        // Set the encoder counter [pag. 209]
+        if(args.size() < 2 || args[0] < 1 || (size_t) args[0] > mChannels)
+            return false;
+        mMotor[args[0] - 1].counter = args[1];
+        return true;
+    }
+    if(name == "D0" || name == "D1")
+    {
+        if(args.empty())
+            return false;
+        int32_t mask = 1 << (args[0] - 1);
+        setParam("DO", 0, (name == "D1") ? (param("DO", 0) | mask) : (param("DO", 0) & ~mask));
+        return true;
+    }
+    // Accepted without effect
+    return (name == "R" || name == "AC" || name == "DC" || name == "B" || name == "VAR");
+}
+
+void board_emulator::execute(const boost::string_ref &cmd, bool record, std::string &out)
+{
+    if(cmd.empty())
+        return;
+    char type = cmd[0];
+    // History buffer [pag. 179]
+    if(type == '#')
+    {
+        boost::string_ref arg = cmd.substr(1);
+        while(!arg.empty() && arg[0] == ' ') arg.remove_prefix(1);
+        if(arg.empty())
+        {
+            // Repeat once
+            for(size_t i = 0; i < mHistory.size(); ++i)
+                execute(mHistory[i], false, out);
+        }
+        else if(arg[0] == 'C' || arg[0] == 'c')
+        {
+            mHistory.clear();
+            mRepeat = 0;
+        }
+        else
+        {
+            mRepeat = std::max(atoi(std::string(arg.data(), arg.size()).c_str()), 1);
+            mNextRepeat = clock_t::now() + std::chrono::milliseconds(mRepeat);
+        }
+        return;
+    }
+    // Name and arguments
+    boost::string_ref body = cmd.substr(1);
+    size_t sep = body.find(' ');
+    std::string name(body.data(), (sep == boost::string_ref::npos) ? body.size() : sep);
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    std::vector<int32_t> args;
+    if(sep != boost::string_ref::npos)
+        parse_args(body.substr(sep + 1), args);
+    update();
+    switch(type)
+    {
+    case '?':
+    {
+        size_t size = out.size();
+        if(query(name, args, out))
+        {
+            out += "\r";
+            if(record && mRepeat == 0 && mHistory.size() < max_history)
+                mHistory.push_back(std::string(cmd.data(), cmd.size()));
+        }
+        else
+        {
+            out.resize(size);
+            out += "-\r";
+        }
+        break;
+    }
+    case '!':
+        out += command(name, args) ? "+\r" : "-\r";
+        break;
+    case '^':
+        if(args.empty())
+        {
+            out += "-\r";
+            break;
+        }
+        if(args.size() == 1 || is_board_param(name))
+            setParam(name, 0, args[0]);
+        else
+            setParam(name, args[0], args[1]);
+        out += "+\r";
+        break;
+    case '~':
+        out += name + "=";
+        if(!args.empty())
+        {
+            out += std::to_string(param(name, args[0]));
+        }
+        else if(is_board_param(name))
+        {
+            out += std::to_string(param(name, 0));
+        }
+        else
+        {
+            for(size_t ch = 1; ch <= mChannels; ++ch)
+            {
+                if(ch > 1) out += ":";
+                out += std::to_string(param(name, ch));
+            }
+        }
+        out += "\r";
+        break;
+    case '%':
+        // Ready to download a script [pag. 183]
+        if(name == "SLD")
+            out += "HLD\r";
+        else
+            out += "+\r";
+        break;
+    default:
+        out += "-\r";
+        break;
+    }
+}
+
+void board_emulator::process(const boost::string_ref &line, std::string &out)
+{
+    // Echo of the line received
+    if(param("ECHOF", 0) == 0)
+    {
+        out.append(line.data(), line.size());
+        out += "\r";
+    }
+    boost::string_ref rest = line;
+    while(!rest.empty())
+    {
+        size_t end = rest.find('_');
+        boost::string_ref cmd = rest.substr(0, end);
+        rest = (end == boost::string_ref::npos) ? boost::string_ref() : rest.substr(end + 1);
+        while(!cmd.empty() && cmd[0] == ' ') cmd.remove_prefix(1);
+        execute(cmd, true, out);
+    }
+}
+
+int board_emulator::repeat(std::string &out)
+{
+    if(mRepeat == 0)
+        return -1;
+    clock_t::time_point now = clock_t::now();
+    if(now >= mNextRepeat)
+    {
+        for(size_t i = 0; i < mHistory.size(); ++i)
+            execute(mHistory[i], false, out);
+        mNextRepeat += std::chrono::milliseconds(mRepeat);
+        if(mNextRepeat < now)
+            mNextRepeat = now + std::chrono::milliseconds(mRepeat);
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(mNextRepeat - now).count();
+}
+
+}
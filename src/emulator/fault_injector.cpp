@@ -0,0 +1,156 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "emulator/fault_injector.h"
+
+#include <cmath>
+
+namespace emulator {
+
+typedef struct _named_profile {
+    const char* name;
+    fault_profile_t profile;
+} named_profile_t;
+
+// drop, corrupt, delay, jitter, burst rate and length, disconnect period and length
+const named_profile_t profiles[] = {
+    {"clean", {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    // EMI on the cable
+    {"noisy", {1e-4, 1e-3, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    // Busy board and USB scheduling
+    {"laggy", {0.0, 0.0, 1.0, 2.0, 0.2, 50.0, 0.0, 0.0}},
+    // USB adapter reset
+    {"flaky", {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 60.0, 2000.0}},
+    // All together
+    {"field", {1e-5, 1e-4, 0.5, 1.0, 0.05, 100.0, 300.0, 3000.0}},
+    {NULL, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0}}
+};
+
+bool get_fault_profile(const std::string &name, fault_profile_t &profile)
+{
+    for(size_t i = 0; profiles[i].name != NULL; ++i)
+    {
+        if(name.compare(profiles[i].name) == 0)
+        {
+            profile = profiles[i].profile;
+            return true;
+        }
+    }
+    return false;
+}
+
+fault_injector::fault_injector(const fault_profile_t &profile, uint32_t seed)
+    : dropped(0)
+    , corrupted(0)
+    , bursts(0)
+    , disconnects(0)
+    , mProfile(profile)
+    , mRandom(seed)
+    , mUniform(0.0, 1.0)
+    , mBurstEnd(clock_t::now())
+    , mLastBurst(clock_t::now())
+{
+    mNextDisconnect = clock_t::now() + std::chrono::duration_cast<clock_t::duration>(
+                std::chrono::duration<double>(mProfile.disconnect_period));
+}
+
+void fault_injector::impair(std::string &data)
+{
+    if(mProfile.corrupt_rate > 0)
+    {
+        // A byte of the line is changed, the end of line is kept
+        size_t start = 0;
+        while(start < data.size())
+        {
+            size_t end = data.find('\r', start);
+            if(end == std::string::npos)
+                end = data.size();
+            if(end > start && mUniform(mRandom) < mProfile.corrupt_rate)
+            {
+                size_t pos = start + static_cast<size_t>(mUniform(mRandom) * (end - start)) % (end - start);
+                data[pos] = static_cast<char>(0x21 + static_cast<int>(mUniform(mRandom) * 94));
+                corrupted++;
+            }
+            start = end + 1;
+        }
+    }
+    if(mProfile.drop_rate > 0)
+    {
+        size_t out = 0;
+        for(size_t i = 0; i < data.size(); ++i)
+        {
+            if(mUniform(mRandom) < mProfile.drop_rate)
+            {
+                dropped++;
+                continue;
+            }
+            data[out++] = data[i];
+        }
+        data.resize(out);
+    }
+}
+
+fault_injector::clock_t::duration fault_injector::latency()
+{
+    clock_t::time_point now = clock_t::now();
+    if(mProfile.burst_rate > 0 && now >= mBurstEnd)
+    {
+        // Poisson arrivals of the spikes
+        double elapsed = std::chrono::duration<double>(now - mLastBurst).count();
+        if(mUniform(mRandom) < 1.0 - std::exp(-mProfile.burst_rate * elapsed))
+        {
+            mBurstEnd = now + std::chrono::duration_cast<clock_t::duration>(
+                        std::chrono::duration<double, std::milli>(mProfile.burst_length));
+            bursts++;
+        }
+    }
+    mLastBurst = now;
+    double delay = mProfile.delay + mProfile.jitter * mUniform(mRandom);
+    clock_t::duration total = std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<double, std::milli>(delay));
+    // The replies wait the end of the spike
+    if(mBurstEnd > now)
+        total += mBurstEnd - now;
+    return total;
+}
+
+fault_injector::clock_t::duration fault_injector::disconnect()
+{
+    if(mProfile.disconnect_period <= 0)
+        return clock_t::duration::zero();
+    clock_t::time_point now = clock_t::now();
+    if(now < mNextDisconnect)
+        return clock_t::duration::zero();
+    mNextDisconnect = now + std::chrono::duration_cast<clock_t::duration>(
+                std::chrono::duration<double>(mProfile.disconnect_period));
+    disconnects++;
+    return std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<double, std::milli>(mProfile.disconnect_length));
+}
+
+}
@@ -0,0 +1,323 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Emulator of a Roboteq board on a pseudo terminal. The driver is started with
+ * the port printed at the start, or with the link created with --link.
+ * The time to transfer each byte is emulated to run at a realistic baud rate,
+ * and a fault profile can impair the link for the soak benchmarks.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "roboteq/transport.h"
+#include "roboteq/line_framer.h"
+#include "emulator/board_emulator.h"
+#include "emulator/fault_injector.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+static std::atomic<bool> running(true);
+
+static void on_signal(int)
+{
+    running = false;
+}
+
+/**
+ * @brief The paced_writer class Send the replies in a thread at the speed of the line
+ */
+class paced_writer
+{
+public:
+    paced_writer(roboteq::pty_transport *port, std::chrono::nanoseconds byte_time)
+        : mPort(port)
+        , mByteTime(byte_time)
+        , mClock(clock_type::now())
+        , mThread(&paced_writer::run, this)
+    {
+    }
+    ~paced_writer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCv.notify_one();
+        mThread.join();
+    }
+    /**
+     * @brief send Queue the bytes to send
+     * @param data The bytes
+     * @param delay The delay before the first byte
+     */
+    void send(const std::string &data, clock_type::duration delay)
+    {
+        if(data.empty())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPending.push_back(chunk_t(clock_type::now() + delay, data));
+        }
+        mCv.notify_one();
+    }
+    /**
+     * @brief disconnect Close the pseudo terminal, the replies queued are lost
+     * @param length The length of the disconnection
+     * @return false if the pseudo terminal is not open again
+     */
+    bool disconnect(clock_type::duration length)
+    {
+        std::lock_guard<std::mutex> port(mPortMutex);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPending.clear();
+        }
+        mPort->close();
+        std::this_thread::sleep_for(length);
+        return mPort->open();
+    }
+
+private:
+    typedef std::pair<clock_type::time_point, std::string> chunk_t;
+    roboteq::pty_transport *mPort;
+    std::chrono::nanoseconds mByteTime;
+    clock_type::time_point mClock;
+    std::mutex mMutex, mPortMutex;
+    std::condition_variable mCv;
+    std::deque<chunk_t> mPending;
+    bool mStop = false;
+    std::thread mThread;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while(!mStop)
+        {
+            mCv.wait(lock, [this]{ return mStop || !mPending.empty(); });
+            if(mStop)
+                break;
+            chunk_t chunk;
+            chunk.swap(mPending.front());
+            mPending.pop_front();
+            lock.unlock();
+            // Each byte is sent after the previous one, the delayed replies keep the order
+            mClock = std::max(mClock, chunk.first);
+            size_t start = 0;
+            while(start < chunk.second.size())
+            {
+                size_t end = std::min(chunk.second.find('\r', start), chunk.second.size() - 1) + 1;
+                mClock += mByteTime * (end - start);
+                std::this_thread::sleep_until(mClock);
+                {
+                    std::lock_guard<std::mutex> port(mPortMutex);
+                    if(mPort->isOpen())
+                        mPort->write(chunk.second.data() + start, end - start);
+                }
+                start = end;
+            }
+            lock.lock();
+        }
+    }
+};
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+                    "  --baud N              Baud rate emulated, default 115200\n"
+                    "  --byte-delay us       Time of a byte in microseconds, default 10 bits at the baud rate\n"
+                    "  --channels N          Number of channels, default 2\n"
+                    "  --link path           Symbolic link to the pseudo terminal\n"
+                    "  --profile name        Faults: clean, noisy, laggy, flaky or field, default clean\n"
+                    "  --drop p              Probability to drop a byte\n"
+                    "  --corrupt p           Probability to corrupt a line\n"
+                    "  --delay ms            Delay of the replies\n"
+                    "  --jitter ms           Uniform jitter of the replies\n"
+                    "  --burst-rate n        Latency spikes for second\n"
+                    "  --burst-length ms     Length of a latency spike\n"
+                    "  --disconnect-period s Period of the disconnections\n"
+                    "  --disconnect-length ms Length of a disconnection\n"
+                    "  --seed N              Seed of the faults, default 1\n", name);
+}
+
+/**
+ * @brief publish Print the slave side and update the link
+ * @param port The pseudo terminal
+ * @param link The symbolic link, can be empty
+ * @return false if the link is not created
+ */
+static bool publish(const roboteq::pty_transport &port, const std::string &link)
+{
+    if(!link.empty())
+    {
+        unlink(link.c_str());
+        if(symlink(port.slaveName().c_str(), link.c_str()) != 0)
+        {
+            fprintf(stderr, "Link %s: %s\n", link.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    printf("%s\n", port.slaveName().c_str());
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long baud = 115200;
+    double byte_delay = -1;
+    size_t channels = 2;
+    std::string link;
+    uint32_t seed = 1;
+    emulator::fault_profile_t profile;
+    emulator::get_fault_profile("clean", profile);
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if(i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        if(arg == "--baud") baud = strtoul(value, NULL, 10);
+        else if(arg == "--byte-delay") byte_delay = atof(value);
+        else if(arg == "--channels") channels = strtoul(value, NULL, 10);
+        else if(arg == "--link") link = value;
+        else if(arg == "--seed") seed = strtoul(value, NULL, 10);
+        else if(arg == "--drop") profile.drop_rate = atof(value);
+        else if(arg == "--corrupt") profile.corrupt_rate = atof(value);
+        else if(arg == "--delay") profile.delay = atof(value);
+        else if(arg == "--jitter") profile.jitter = atof(value);
+        else if(arg == "--burst-rate") profile.burst_rate = atof(value);
+        else if(arg == "--burst-length") profile.burst_length = atof(value);
+        else if(arg == "--disconnect-period") profile.disconnect_period = atof(value);
+        else if(arg == "--disconnect-length") profile.disconnect_length = atof(value);
+        else if(arg == "--profile" && emulator::get_fault_profile(value, profile)) {}
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    // Start, 8 data and stop bits
+    if(byte_delay < 0)
+        byte_delay = (baud > 0) ? 10.0e6 / baud : 0;
+    std::chrono::nanoseconds byte_time(static_cast<long long>(byte_delay * 1000.0));
+
+    roboteq::pty_transport port;
+    if(!port.open())
+    {
+        fprintf(stderr, "Open pseudo terminal: %s\n", port.error().c_str());
+        return 1;
+    }
+    if(!publish(port, link))
+        return 1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    emulator::board_emulator board(channels);
+    emulator::fault_injector faults(profile, seed);
+    roboteq::line_framer framer;
+    std::string in, out;
+    clock_type::time_point rx_clock = clock_type::now();
+    {
+        paced_writer writer(&port, byte_time);
+        int timeout = 100;
+        while(running)
+        {
+            clock_type::duration outage = faults.disconnect();
+            if(outage > clock_type::duration::zero())
+            {
+                // The driver see the port closed, the board keep the state
+                fprintf(stderr, "Disconnect for %.0fms\n", std::chrono::duration<double, std::milli>(outage).count());
+                if(!writer.disconnect(outage) || !publish(port, link))
+                {
+                    fprintf(stderr, "Open pseudo terminal: %s\n", port.error().c_str());
+                    break;
+                }
+                framer.clear();
+            }
+            size_t size;
+            char* buffer = framer.prepare(size);
+            long n = port.read(buffer, size, timeout);
+            if(n < 0)
+            {
+                fprintf(stderr, "Read: %s\n", port.error().c_str());
+                break;
+            }
+            if(n > 0)
+            {
+                // The bytes lost from the board
+                in.assign(buffer, n);
+                faults.impair(in);
+                std::copy(in.begin(), in.end(), buffer);
+                n = in.size();
+            }
+            framer.commit(n);
+            out.clear();
+            boost::string_ref line;
+            while(framer.next(line))
+            {
+                // The line is received byte by byte, with the end of line
+                rx_clock = std::max(rx_clock, clock_type::now()) + byte_time * (line.size() + 1);
+                std::this_thread::sleep_until(rx_clock);
+                board.process(line, out);
+            }
+            int next = board.repeat(out);
+            if(!out.empty())
+            {
+                faults.impair(out);
+                writer.send(out, faults.latency());
+            }
+            timeout = (next < 0) ? 100 : std::min(std::max(next, 0), 100);
+        }
+    }
+    fprintf(stderr, "Faults: dropped %lu bytes, corrupted %lu lines, %lu latency spikes, %lu disconnections\n",
+            (unsigned long) faults.dropped, (unsigned long) faults.corrupted,
+            (unsigned long) faults.bursts, (unsigned long) faults.disconnects);
+    port.close();
+    if(!link.empty())
+        unlink(link.c_str());
+    return 0;
+}
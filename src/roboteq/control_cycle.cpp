@@ -0,0 +1,106 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/control_cycle.h"
+
+namespace roboteq {
+
+const char* const board_query[BOARD_FIELDS][2] = {
+    {"FF", ""},     // Fault flag [pag. 245]
+    {"FS", ""},     // Status flag [pag. 247]
+    {"V", "1"},     // Internal voltage [pag. 262]
+    {"V", "3"},     // 5V regulator [pag. 262]
+    {"T", "1"},     // MCU temperature [pag. 259]
+    {"T", "2"}      // Bridge temperature [pag. 259]
+};
+
+const poll_default_t telemetry_plan[TELEMETRY_FIELDS] = {
+    {"flags", 10.0, 12},
+    {"command", 0.0, 18},
+    {"feedback", 0.0, 18},
+    {"loop_error", 10.0, 18},
+    {"power", 10.0, 18},
+    {"volts", 1.0, 5},
+    {"amps", 20.0, 18},
+    {"battery_amps", 5.0, 18},
+    {"counter", 0.0, 36},
+    {"track", 10.0, 36}
+};
+
+const poll_default_t board_plan[BOARD_FIELDS] = {
+    {"fault_flag", 1.0, 3},
+    {"status_flag", 1.0, 3},
+    {"volts_internal", 1.0, 5},
+    {"volts_five", 1.0, 5},
+    {"temp_mcu", 1.0, 4},
+    {"temp_bridge", 1.0, 4}
+};
+
+size_t combined_channels(const command_mailbox_t &mailbox, size_t channels)
+{
+    // The M command set the channels in order from the first
+    if(channels < 2 || mailbox.valid != (1u << channels) - 1)
+        return 0;
+    for(size_t idx = 0; idx < channels; ++idx)
+    {
+        // Only closed loop speed and closed loop speed position
+        if(mailbox.mode[idx] != 1 && mailbox.mode[idx] != 6)
+            return 0;
+        if(mailbox.mode[idx] != mailbox.mode[0])
+            return 0;
+    }
+    return channels;
+}
+
+void format_commands(const command_mailbox_t &mailbox, size_t channels, bool combined, tx_buffer &tx)
+{
+    size_t count = combined ? combined_channels(mailbox, channels) : 0;
+    if(count > 0)
+    {
+        // All channels set in the same tick "!M 100 -100" [pag. 217]
+        tx.command("!", "M");
+        for(size_t idx = 0; idx < count; ++idx)
+        {
+            tx.argument(mailbox.command[idx]);
+        }
+        return;
+    }
+    // Format all commands in a single line "!G 1 100_!G 2 -100"
+    for(size_t idx = 0; idx < channels; ++idx)
+    {
+        if(!(mailbox.valid & (1 << idx)))
+            continue;
+        tx.command("!", "G");
+        tx.argument(static_cast<int32_t>(idx + 1));
+        tx.argument(mailbox.command[idx]);
+    }
+}
+
+}
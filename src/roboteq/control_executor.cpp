@@ -0,0 +1,217 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/control_executor.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+
+namespace roboteq
+{
+
+// Upper limit of each bucket of the jitter histogram in microseconds
+const int64_t jitter_limits[jitter_buckets] = {10, 20, 50, 100, 200, 500, 1000, 2000, 5000, INT64_MAX};
+
+const int64_t nsec_per_sec = 1000000000LL;
+
+inline int64_t to_nsec(const struct timespec &t)
+{
+    return t.tv_sec * nsec_per_sec + t.tv_nsec;
+}
+
+inline struct timespec from_nsec(int64_t ns)
+{
+    struct timespec t;
+    t.tv_sec = ns / nsec_per_sec;
+    t.tv_nsec = ns % nsec_per_sec;
+    return t;
+}
+
+ControlExecutor::ControlExecutor(const executor_config_t &config, const std::function<void ()> &cycle)
+    : DiagnosticTask("Control loop")
+    , _config(config)
+    , _cycle(cycle)
+    , _running(false)
+    , _cycles(0)
+    , _overruns(0)
+    , _missed(0)
+    , _max_jitter(0)
+{
+    for(size_t i = 0; i < jitter_buckets; ++i)
+    {
+        _jitter[i] = 0;
+    }
+}
+
+ControlExecutor::~ControlExecutor()
+{
+    stop();
+}
+
+void ControlExecutor::start()
+{
+    if(_config.lock_memory)
+    {
+        // Avoid page faults in the control loop
+        if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            ROS_WARN_STREAM("Unable to lock memory: " << strerror(errno));
+        }
+    }
+    _running = true;
+    // The control thread inherits a mask without SIGINT and SIGTERM, the handlers run in the other threads
+    sigset_t block, previous;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &previous);
+    _thread = std::thread(&ControlExecutor::loop, this);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    ROS_INFO_STREAM("Control thread started period=" << _config.period << "s priority=" << _config.priority << " cpu=" << _config.cpu);
+}
+
+void ControlExecutor::stop()
+{
+    _running = false;
+    if(_thread.joinable())
+    {
+        _thread.join();
+        ROS_INFO_STREAM("Control thread stopped cycles=" << _cycles << " overruns=" << _overruns);
+    }
+}
+
+void ControlExecutor::setup()
+{
+    if(_config.priority > 0)
+    {
+        struct sched_param param;
+        param.sched_priority = _config.priority;
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(ret != 0)
+        {
+            ROS_WARN_STREAM("Unable to set SCHED_FIFO priority " << _config.priority << ": " << strerror(ret));
+        }
+    }
+    if(_config.cpu >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(_config.cpu, &cpuset);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+        if(ret != 0)
+        {
+            ROS_WARN_STREAM("Unable to set affinity on CPU " << _config.cpu << ": " << strerror(ret));
+        }
+    }
+}
+
+void ControlExecutor::record(int64_t jitter)
+{
+    int64_t usec = jitter / 1000;
+    for(size_t i = 0; i < jitter_buckets; ++i)
+    {
+        if(usec < jitter_limits[i])
+        {
+            _jitter[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    if(jitter > _max_jitter.load(std::memory_order_relaxed))
+    {
+        _max_jitter.store(jitter, std::memory_order_relaxed);
+    }
+}
+
+void ControlExecutor::loop()
+{
+    setup();
+    const int64_t period = static_cast<int64_t>(_config.period * nsec_per_sec);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t deadline = to_nsec(now);
+    while(_running)
+    {
+        // Next absolute deadline
+        deadline += period;
+        struct timespec wakeup = from_nsec(deadline);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) == EINTR);
+        // Delay of the wake up
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        record(to_nsec(now) - deadline);
+        // Process control loop
+        _cycle();
+        _cycles.fetch_add(1, std::memory_order_relaxed);
+        // Check if the cycle is ended after the next deadline
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t end = to_nsec(now);
+        if(end > deadline + period)
+        {
+            _overruns.fetch_add(1, std::memory_order_relaxed);
+            // Skip the missed periods and keep the phase
+            int64_t missed = (end - deadline) / period;
+            _missed.fetch_add(missed, std::memory_order_relaxed);
+            deadline += missed * period;
+        }
+    }
+}
+
+void ControlExecutor::run(diagnostic_updater::DiagnosticStatusWrapper &stat)
+{
+    uint64_t cycles = _cycles.load(std::memory_order_relaxed);
+    uint64_t overruns = _overruns.load(std::memory_order_relaxed);
+    stat.add("Period (s)", _config.period);
+    stat.add("Priority", _config.priority);
+    stat.add("CPU", _config.cpu);
+    stat.add("Cycles", cycles);
+    stat.add("Overruns", overruns);
+    stat.add("Missed periods", _missed.load(std::memory_order_relaxed));
+    stat.add("Max jitter (us)", _max_jitter.load(std::memory_order_relaxed) / 1000.0);
+    int64_t lower = 0;
+    for(size_t i = 0; i < jitter_buckets; ++i)
+    {
+        std::string name = (i < jitter_buckets - 1) ? "Jitter " + std::to_string(lower) + "-" + std::to_string(jitter_limits[i]) + " (us)"
+                                               : "Jitter >" + std::to_string(lower) + " (us)";
+        stat.add(name, _jitter[i].load(std::memory_order_relaxed));
+        lower = jitter_limits[i];
+    }
+
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Control loop running");
+    // More than 1% of cycles late
+    if(cycles > 0 && overruns * 100 > cycles)
+    {
+        stat.mergeSummaryf(diagnostic_msgs::DiagnosticStatus::WARN, "Overruns %lu on %lu cycles", (unsigned long) overruns, (unsigned long) cycles);
+    }
+}
+
+}
@@ -0,0 +1,198 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/flight_recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace roboteq {
+
+const char flight_magic[8] = "RQFLT01";
+
+flight_recorder::flight_recorder()
+    : mEnabled(false)
+    , mHeader(NULL)
+    , mRing(NULL)
+{
+}
+
+flight_recorder::~flight_recorder()
+{
+    stop();
+}
+
+bool flight_recorder::start(const std::string &path, size_t size)
+{
+    stop();
+    if(size < sizeof(flight_header_t) + 64 * sizeof(flight_record_t))
+    {
+        mError = "flight file size too small";
+        return false;
+    }
+    // Keep the black box of the last run, it can be the one of a crash
+    std::rename(path.c_str(), (path + ".1").c_str());
+    uint64_t capacity = (size - sizeof(flight_header_t)) / sizeof(flight_record_t);
+    if(!mFile.create(path, sizeof(flight_header_t) + capacity * sizeof(flight_record_t)))
+    {
+        mError = mFile.error();
+        return false;
+    }
+    mHeader = reinterpret_cast<flight_header_t*>(mFile.data());
+    mRing = reinterpret_cast<flight_record_t*>(mFile.data() + sizeof(flight_header_t));
+    memset(mHeader, 0, sizeof(flight_header_t));
+    mHeader->record_size = sizeof(flight_record_t);
+    mHeader->fields = TELEMETRY_FIELDS;
+    mHeader->capacity = capacity;
+    mHeader->wall_offset = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count()
+            - std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    // The magic is the last, a reader never see a header half written
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(mHeader->magic, flight_magic, sizeof(flight_magic));
+    mEnabled.store(true, std::memory_order_release);
+    return true;
+}
+
+void flight_recorder::stop()
+{
+    if(!mEnabled.load(std::memory_order_acquire))
+        return;
+    mEnabled.store(false, std::memory_order_release);
+    mFile.sync();
+    mFile.close();
+    mHeader = NULL;
+    mRing = NULL;
+}
+
+void flight_recorder::append(const motor_frame_t *frames, size_t channels)
+{
+    uint64_t head = mHeader->head;
+    for(size_t i = 0; i < channels; ++i)
+    {
+        const motor_frame_t &frame = frames[i];
+        if(frame.valid == 0)
+            continue;
+        flight_record_t &slot = mRing[head % mHeader->capacity];
+        // Zero sequence, the reader skip the record
+        __atomic_store_n(&slot.sequence, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        uint64_t stamp = 0;
+        for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        {
+            if(frame.valid & (1 << n))
+                stamp = std::max(stamp, frame.stamp[n]);
+        }
+        slot.stamp = stamp;
+        slot.channel = i;
+        slot.valid = frame.valid;
+        slot.reserved = 0;
+        memcpy(slot.value, frame.value, sizeof(slot.value));
+        __atomic_store_n(&slot.sequence, head + 1, __ATOMIC_RELEASE);
+        ++head;
+    }
+    // The records are complete before the head move
+    __atomic_store_n(&mHeader->head, head, __ATOMIC_RELEASE);
+}
+
+flight_reader::flight_reader()
+    : mRing(NULL)
+    , mIndex(0)
+{
+    memset(&mHeaderCopy, 0, sizeof(mHeaderCopy));
+}
+
+bool flight_reader::open(const std::string &path)
+{
+    close();
+    if(!mFile.open(path))
+    {
+        mError = mFile.error();
+        return false;
+    }
+    if(mFile.size() < sizeof(flight_header_t))
+    {
+        mError = path + ": not a flight file";
+        close();
+        return false;
+    }
+    memcpy(&mHeaderCopy, mFile.data(), sizeof(flight_header_t));
+    if(memcmp(mHeaderCopy.magic, flight_magic, sizeof(flight_magic)) != 0
+            || mHeaderCopy.record_size != sizeof(flight_record_t)
+            || mHeaderCopy.fields != TELEMETRY_FIELDS
+            || mHeaderCopy.capacity == 0
+            || sizeof(flight_header_t) + mHeaderCopy.capacity * sizeof(flight_record_t) > mFile.size())
+    {
+        mError = path + ": not a flight file";
+        close();
+        return false;
+    }
+    mRing = reinterpret_cast<const flight_record_t*>(mFile.data() + sizeof(flight_header_t));
+    rewind();
+    return true;
+}
+
+void flight_reader::close()
+{
+    mFile.close();
+    mRing = NULL;
+}
+
+void flight_reader::rewind()
+{
+    if(mRing == NULL)
+        return;
+    // The head of the file, it move if the driver is still running
+    uint64_t head = __atomic_load_n(&reinterpret_cast<const flight_header_t*>(mFile.data())->head, __ATOMIC_ACQUIRE);
+    mHeaderCopy.head = head;
+    mIndex = (head > mHeaderCopy.capacity) ? head - mHeaderCopy.capacity : 0;
+}
+
+bool flight_reader::next(flight_record_t &record)
+{
+    while(mRing != NULL && mIndex < mHeaderCopy.head)
+    {
+        const flight_record_t &slot = mRing[mIndex % mHeaderCopy.capacity];
+        uint64_t index = mIndex++;
+        uint64_t before = __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+        memcpy(&record, &slot, sizeof(record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // Written after a crash in the middle or overwritten during the read
+        if(before != index + 1 || __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) != before)
+            continue;
+        return true;
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,183 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace roboteq {
+
+latency_histogram::latency_histogram()
+    : mCount(0)
+    , mSum(0)
+    , mMax(0)
+{
+    for(unsigned i = 0; i < buckets; ++i)
+        mCounts[i] = 0;
+}
+
+double latency_histogram::value(unsigned idx)
+{
+    if(idx < sub_count)
+        return idx;
+    unsigned shift = idx / sub_count - 1;
+    uint64_t lower = static_cast<uint64_t>(idx % sub_count + sub_count) << shift;
+    return lower + ((1ULL << shift) - 1) / 2.0;
+}
+
+double latency_histogram::percentile(double q) const
+{
+    // The counters can move while reading, the total is from the buckets
+    uint64_t total = 0;
+    for(unsigned i = 0; i < buckets; ++i)
+        total += mCounts[i].load(std::memory_order_relaxed);
+    if(total == 0)
+        return 0;
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total)));
+    uint64_t cumulative = 0;
+    for(unsigned i = 0; i < buckets; ++i)
+    {
+        cumulative += mCounts[i].load(std::memory_order_relaxed);
+        if(cumulative >= target)
+            return std::min(value(i), static_cast<double>(max()));
+    }
+    return max();
+}
+
+double latency_histogram::mean() const
+{
+    uint64_t n = count();
+    return (n > 0) ? static_cast<double>(mSum.load(std::memory_order_relaxed)) / n : 0;
+}
+
+command_latency::command_latency()
+{
+    for(size_t i = 0; i < max_mnemonics; ++i)
+    {
+        mSlots[i].key = 0;
+        mSlots[i].retries = 0;
+        mSlots[i].timeouts = 0;
+    }
+}
+
+command_latency::slot_t* command_latency::find(uint64_t key)
+{
+    if(key == 0)
+        return NULL;
+    // Open addressing with linear probing, the slots are never removed
+    size_t start = ((key * 0x9E3779B97F4A7C15ULL) >> 32) % max_mnemonics;
+    for(size_t i = 0; i < max_mnemonics; ++i)
+    {
+        slot_t &slot = mSlots[(start + i) % max_mnemonics];
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if(current == key)
+            return &slot;
+        if(current == 0)
+        {
+            if(slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel) || current == key)
+                return &slot;
+        }
+    }
+    return NULL;
+}
+
+void command_latency::record(uint64_t key, uint64_t us)
+{
+    slot_t* slot = find(key);
+    if(slot != NULL)
+        slot->histogram.record(us);
+}
+
+void command_latency::retry(uint64_t key)
+{
+    slot_t* slot = find(key);
+    if(slot != NULL)
+        slot->retries.fetch_add(1, std::memory_order_relaxed);
+}
+
+void command_latency::timeout(uint64_t key)
+{
+    slot_t* slot = find(key);
+    if(slot != NULL)
+        slot->timeouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+static bool by_name(const latency_summary_t &a, const latency_summary_t &b)
+{
+    return a.name < b.name;
+}
+
+void command_latency::summary(std::vector<latency_summary_t> &summary) const
+{
+    summary.clear();
+    for(size_t i = 0; i < max_mnemonics; ++i)
+    {
+        const slot_t &slot = mSlots[i];
+        uint64_t key = slot.key.load(std::memory_order_acquire);
+        if(key == 0)
+            continue;
+        latency_summary_t item;
+        for(; key != 0; key >>= 8)
+            item.name += static_cast<char>(key & 0xFF);
+        item.count = slot.histogram.count();
+        item.retries = slot.retries.load(std::memory_order_relaxed);
+        item.timeouts = slot.timeouts.load(std::memory_order_relaxed);
+        item.mean = slot.histogram.mean();
+        item.p50 = slot.histogram.percentile(0.50);
+        item.p90 = slot.histogram.percentile(0.90);
+        item.p99 = slot.histogram.percentile(0.99);
+        item.p999 = slot.histogram.percentile(0.999);
+        item.max = slot.histogram.max();
+        summary.push_back(item);
+    }
+    std::sort(summary.begin(), summary.end(), by_name);
+}
+
+std::string command_latency::dump() const
+{
+    std::vector<latency_summary_t> items;
+    summary(items);
+    std::string table = "\nmnemonic    count   mean(ms)  p50(ms)  p90(ms)  p99(ms) p99.9(ms)  max(ms) retries timeouts\n";
+    char line[160];
+    for(size_t i = 0; i < items.size(); ++i)
+    {
+        const latency_summary_t &item = items[i];
+        snprintf(line, sizeof(line), "%-8s %8lu %10.3f %8.3f %8.3f %8.3f %9.3f %8.3f %7lu %8lu\n",
+                 item.name.c_str(), (unsigned long) item.count, item.mean / 1000.0, item.p50 / 1000.0,
+                 item.p90 / 1000.0, item.p99 / 1000.0, item.p999 / 1000.0, item.max / 1000.0,
+                 (unsigned long) item.retries, (unsigned long) item.timeouts);
+        table += line;
+    }
+    return table;
+}
+
+}
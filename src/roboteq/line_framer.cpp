@@ -0,0 +1,146 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/line_framer.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace roboteq {
+
+// End of line from Roboteq board
+const char eol_char('\r');
+
+line_type_t scan_line(const boost::string_ref &line, boost::string_ref &name, boost::string_ref &data)
+{
+    if(line.empty())
+        return LINE_EMPTY;
+    // Command status
+    if(line.size() == 1)
+    {
+        if(line[0] == '+') return LINE_ACK;
+        if(line[0] == '-') return LINE_NACK;
+    }
+    // Query reply NAME=DATA
+    const char* sep = static_cast<const char*>(memchr(line.data(), '=', line.size()));
+    if(sep != NULL)
+    {
+        size_t pos = sep - line.data();
+        if(pos > 0 && pos < line.size() - 1)
+        {
+            name = line.substr(0, pos);
+            data = line.substr(pos + 1);
+            return LINE_QUERY;
+        }
+    }
+    else if(line == "HLD")
+    {
+        return LINE_HLD;
+    }
+    return LINE_OTHER;
+}
+
+line_framer::line_framer()
+    : mHead(0)
+    , mTail(0)
+    , mScan(0)
+    , mOverflows(0)
+{
+}
+
+char* line_framer::prepare(size_t &size)
+{
+    // A line longer than the buffer is dropped
+    if(mHead - mTail == buffer_size)
+    {
+        mOverflows++;
+        mTail = mScan = mHead;
+    }
+    size_t offset = mHead & (buffer_size - 1);
+    size = std::min(buffer_size - (mHead - mTail), buffer_size - offset);
+    return &mBuffer[offset];
+}
+
+void line_framer::commit(size_t size)
+{
+    mHead += size;
+}
+
+bool line_framer::next(boost::string_ref &line)
+{
+    while(mScan != mHead)
+    {
+        // Scan the contiguous part of the buffer
+        size_t offset = mScan & (buffer_size - 1);
+        size_t size = std::min(mHead - mScan, buffer_size - offset);
+        const char* found = static_cast<const char*>(memchr(&mBuffer[offset], eol_char, size));
+        if(found == NULL)
+        {
+            mScan += size;
+            continue;
+        }
+        size_t end = mScan + (found - &mBuffer[offset]);
+        size_t start = mTail;
+        size_t length = end - start;
+        // Next line
+        mTail = mScan = end + 1;
+        // Skip new line characters and empty lines
+        while(length > 0 && mBuffer[start & (buffer_size - 1)] == '\n')
+        {
+            start++;
+            length--;
+        }
+        if(length == 0)
+            continue;
+        if(length > max_line_length)
+        {
+            mOverflows++;
+            continue;
+        }
+        size_t first = start & (buffer_size - 1);
+        if(first + length <= buffer_size)
+        {
+            // Slice of the ring buffer
+            line = boost::string_ref(&mBuffer[first], length);
+        }
+        else
+        {
+            // The line wrap around the end of the ring buffer
+            size_t part = buffer_size - first;
+            memcpy(mLine, &mBuffer[first], part);
+            memcpy(mLine + part, mBuffer, length - part);
+            line = boost::string_ref(mLine, length);
+        }
+        return true;
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/link_monitor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace roboteq {
+
+// Timeout before the first sample in us
+const double initial_rto(100000.0);
+// Limits of the timeout in us
+const double min_rto(5000.0);
+const double max_rto(1000000.0);
+// Granularity G of the estimator in us: scheduling and USB latency timer of the adapters
+const double granularity(5000.0);
+// Requests lost in a row to degrade the link
+const unsigned int failure_threshold(5);
+
+link_monitor::link_monitor()
+    : mStats()
+    , mFailures(0)
+{
+    mStats.rto = initial_rto;
+}
+
+void link_monitor::sample(duration_t rtt)
+{
+    double r = std::chrono::duration<double, std::micro>(rtt).count();
+    if(mStats.samples == 0)
+    {
+        mStats.srtt = r;
+        mStats.rttvar = r / 2.0;
+    }
+    else
+    {
+        // alpha = 1/8, beta = 1/4
+        mStats.rttvar = 0.75 * mStats.rttvar + 0.25 * std::fabs(mStats.srtt - r);
+        mStats.srtt = 0.875 * mStats.srtt + 0.125 * r;
+    }
+    mStats.samples++;
+    mStats.rto = std::min(std::max(mStats.srtt + std::max(granularity, 4.0 * mStats.rttvar), min_rto), max_rto);
+}
+
+link_monitor::duration_t link_monitor::timeout(unsigned int attempt) const
+{
+    double rto = std::min(mStats.rto * (1 << std::min(attempt, 8u)), max_rto);
+    return std::chrono::duration_cast<duration_t>(std::chrono::duration<double, std::micro>(rto));
+}
+
+bool link_monitor::success()
+{
+    bool recovered = mStats.degraded;
+    mFailures = 0;
+    mStats.degraded = false;
+    return recovered;
+}
+
+bool link_monitor::failure()
+{
+    mStats.timeouts++;
+    mFailures++;
+    if(!mStats.degraded && mFailures >= failure_threshold)
+    {
+        mStats.degraded = true;
+        return true;
+    }
+    return false;
+}
+
+link_stats_t link_monitor::getStats() const
+{
+    return mStats;
+}
+
+}
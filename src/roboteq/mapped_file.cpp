@@ -0,0 +1,128 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/mapped_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace roboteq {
+
+mapped_file::mapped_file()
+    : mFd(-1)
+    , mMap(NULL)
+    , mSize(0)
+{
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+bool mapped_file::create(const std::string &path, size_t size)
+{
+    close();
+    mFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(mFd < 0)
+    {
+        mError = path + ": " + strerror(errno);
+        return false;
+    }
+    // Reserve all blocks now, a full disk fail here and not in the writer
+    int err = posix_fallocate(mFd, 0, size);
+    if(err != 0)
+    {
+        mError = path + ": " + strerror(err);
+        close();
+        return false;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if(map == MAP_FAILED)
+    {
+        mError = path + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    mMap = static_cast<char*>(map);
+    mSize = size;
+    return true;
+}
+
+bool mapped_file::open(const std::string &path)
+{
+    close();
+    mFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(mFd < 0)
+    {
+        mError = path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if(fstat(mFd, &st) < 0 || st.st_size == 0)
+    {
+        mError = path + ": empty file";
+        close();
+        return false;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, mFd, 0);
+    if(map == MAP_FAILED)
+    {
+        mError = path + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    mMap = static_cast<char*>(map);
+    mSize = st.st_size;
+    return true;
+}
+
+void mapped_file::sync()
+{
+    if(mMap != NULL)
+        msync(mMap, mSize, MS_SYNC);
+}
+
+void mapped_file::close()
+{
+    if(mMap != NULL)
+        munmap(mMap, mSize);
+    if(mFd >= 0)
+        ::close(mFd);
+    mMap = NULL;
+    mSize = 0;
+    mFd = -1;
+}
+
+}
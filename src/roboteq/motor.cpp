@@ -29,6 +29,7 @@
  */
 
 #include "roboteq/motor.h"
+#include "roboteq/control_cycle.h"
 
 #include <hardware_interface/joint_state_interface.h>
 #include <hardware_interface/joint_command_interface.h>
@@ -55,6 +56,8 @@ Motor::Motor(const ros::NodeHandle& nh, serial_controller *serial, string name,
     effort = 0;
     // Initialize control mode
     _control_mode = -1;
+    // No sensor registered
+    _sensor = NULL;
 
     // Initialize Dynamic reconfigurator for generic parameters
     parameter = new MotorParamConfigurator(nh, serial, mMotorName, number);
@@ -66,9 +69,6 @@ Motor::Motor(const ros::NodeHandle& nh, serial_controller *serial, string name,
     // Add a status motor publisher
     pub_status = mNh.advertise<roboteq_control::MotorStatus>(mMotorName + "/status", 10);
     pub_control = mNh.advertise<roboteq_control::ControlStatus>(mMotorName + "/control", 10);
-
-    // Add callback
-    // mSerial->addCallback(&Motor::read, this, "F" + std::to_string(mNumber));
 }
 
 void Motor::connectionCallback(const ros::SingleSubscriberPublisher& pub)
@@ -108,9 +108,8 @@ void Motor::initializeMotor(bool load_from_board)
  */
 double Motor::to_encoder_ticks(double x)
 {
-    double reduction = 0;
     // Get ratio
-    mNh.getParam(mMotorName + "/ratio", reduction);
+    double reduction = parameter->getRatio();
     //ROS_INFO_STREAM("to_encoder_ticks:" << reduction);
     // apply the reduction convertion
     if(_sensor != NULL)
@@ -127,9 +126,8 @@ double Motor::to_encoder_ticks(double x)
  */
 double Motor::from_encoder_ticks(double x)
 {
-    double reduction = 0;
     // Get ratio
-    mNh.getParam(mMotorName + "/ratio", reduction);
+    double reduction = parameter->getRatio();
     // apply the reduction convertion
     if(_sensor != NULL)
         reduction = _sensor->getConversion(reduction);
@@ -210,6 +208,9 @@ void Motor::setupLimits(urdf::Model model)
 
 void Motor::run(diagnostic_updater::DiagnosticStatusWrapper &stat)
 {
+    // Last state from the control loop
+    motor_state_t state;
+    _state.read(state);
     string control;
     switch(_control_mode)
     {
@@ -244,52 +245,52 @@ void Motor::run(diagnostic_updater::DiagnosticStatusWrapper &stat)
     stat.add("Control", control);
 
     stat.add("Motor number", mNumber);
-    stat.add("PWM rate (%)", msg_control.pwm);
-    stat.add("Voltage (V)", msg_status.volts);
-    stat.add("Battery (A)", msg_status.amps_batt);
-    stat.add("Watt motor (W)", msg_status.volts * msg_status.amps_motor);
-    stat.add("Watt batt (W)", msg_status.volts * msg_status.amps_batt);
-    stat.add("Loop error", msg_control.loop_error);
-    stat.add("Track", msg_status.track);
-    stat.add("Position (deg)", position);
-    stat.add("Velociy (RPM)", to_rpm(velocity));
-    stat.add("Current (A)", msg_status.amps_motor);
-    stat.add("Torque (Nm)", effort);
+    stat.add("PWM rate (%)", state.pwm);
+    stat.add("Voltage (V)", state.volts);
+    stat.add("Battery (A)", state.amps_batt);
+    stat.add("Watt motor (W)", state.volts * state.amps_motor);
+    stat.add("Watt batt (W)", state.volts * state.amps_batt);
+    stat.add("Loop error", state.loop_error);
+    stat.add("Track", state.track);
+    stat.add("Position (deg)", state.position);
+    stat.add("Velociy (RPM)", to_rpm(state.velocity));
+    stat.add("Current (A)", state.amps_motor);
+    stat.add("Torque (Nm)", state.effort);
 
 
     stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Motor Ready!");
 
-    if(_status.amps_limit)
+    if(state.status.amps_limit)
     {
-        stat.mergeSummaryf(diagnostic_msgs::DiagnosticStatus::ERROR, "Amps limits motor=%.2f", msg_status.amps_motor);
+        stat.mergeSummaryf(diagnostic_msgs::DiagnosticStatus::ERROR, "Amps limits motor=%.2f", state.amps_motor);
     }
 
-    if(_status.amps_triggered_active)
+    if(state.status.amps_triggered_active)
     {
         stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Amps trigger active");
     }
 
-    if(_status.forward_limit_triggered)
+    if(state.status.forward_limit_triggered)
     {
         stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Forward limit triggered");
     }
 
-    if(_status.reverse_limit_triggered)
+    if(state.status.reverse_limit_triggered)
     {
         stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Reverse limit triggered");
     }
 
-    if(_status.loop_error_detect)
+    if(state.status.loop_error_detect)
     {
         stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::ERROR, "Loop error detection");
     }
 
-    if(_status.motor_stalled)
+    if(state.status.motor_stalled)
     {
         stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::ERROR, "Motor stalled");
     }
 
-    if(_status.safety_stop_active)
+    if(state.status.safety_stop_active)
     {
         stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Safety stop active");
     }
@@ -297,10 +298,10 @@ void Motor::run(diagnostic_updater::DiagnosticStatusWrapper &stat)
 
 void Motor::stopMotor()
 {
-    // set to zero the reference
-    mSerial->command("G ", std::to_string(mNumber) + " 0");
+    // set to zero the reference, a one-shot command is retried as the parameters
+    mSerial->command("G ", std::to_string(mNumber) + " 0", "!", PRIORITY_CONFIG);
     // Stop motor [pag 222]
-    mSerial->command("MS", std::to_string(mNumber));
+    mSerial->command("MS", std::to_string(mNumber), "!", PRIORITY_CONFIG);
 }
 
 void Motor::switchController(string type)
@@ -327,100 +328,108 @@ void Motor::resetPosition(double position)
 {
     // Send reset position
     double enc_conv = to_encoder_ticks(position);
-    mSerial->command("C ", std::to_string(mNumber) + " " + std::to_string(enc_conv));
+    mSerial->command("C ", std::to_string(mNumber) + " " + std::to_string(enc_conv), "!", PRIORITY_CONFIG);
 }
 
-void Motor::writeCommandsToHardware(ros::Duration period)
+int32_t Motor::buildCommand(ros::Duration period)
 {
     // Enforce joint limits for all registered handles
     // Note: one can also enforce limits on a per-handle basis: handle.enforceLimits(period)
     vel_limits_interface.enforceLimits(period);
     // Get encoder max speed parameter
-    double max_rpm;
-    mNh.getParam(mMotorName + "/max_speed", max_rpm);
+    double max_rpm = parameter->getMaxSpeed();
     // Build a command message
-    long long int roboteq_velocity = static_cast<long long int>(to_rpm(command) / max_rpm * 1000.0);
+    int32_t roboteq_velocity = velocity_command(to_rpm(command), max_rpm);
 
     // ROS_INFO_STREAM("Velocity" << mNumber << " val=" << command << " " << roboteq_velocity);
-
-    mSerial->command("G ", std::to_string(mNumber) + " " + std::to_string(roboteq_velocity));
+    return roboteq_velocity;
 }
 
-void Motor::read(string data) {
-    std::vector<std::string> fields;
-    boost::split(fields, data, boost::algorithm::is_any_of(":"));
-    // Decode list
-    readVector(fields);
+void Motor::writeCommandsToHardware(ros::Duration period)
+{
+    mSerial->command("G ", std::to_string(mNumber) + " " + std::to_string(buildCommand(period)));
 }
 
-void Motor::readVector(std::vector<std::string> fields) {
-    double ratio, max_rpm;
+void Motor::readVector(const motor_frame_t &frame) {
     // ROS_INFO_STREAM("Motor" << mNumber << " " << data);
-
+    // A lost reply or a decoding error leave the frame incomplete
+    if(frame.valid != frame_complete)
+    {
+        ROS_WARN("Failure parsing feedback data. Dropping message.");
+        return;
+    }
 
     // Get ratio
-    mNh.getParam(mMotorName + "/ratio", ratio);
+    double ratio = parameter->getRatio();
     // Get encoder max speed parameter
-    mNh.getParam(mMotorName + "/max_speed", max_rpm);
+    double max_rpm = parameter->getMaxSpeed();
     // Build messages
     msg_status.header.stamp = ros::Time::now();
     msg_control.header.stamp = ros::Time::now();
 
     // Scale factors as outlined in the relevant portions of the user manual, please
     // see mbs/script.mbs for URL and specific page references.
-    try
-    {
-        // reference command FM <-> _MOTFLAG [pag. 246]
-        unsigned char status = boost::lexical_cast<unsigned int>(fields[0]);
-        memcpy(&_status, &status, sizeof(status));
-
-        // reference command M <-> _MOTCMD [pag. 250]
-        double cmd = boost::lexical_cast<double>(fields[1]) * max_rpm / 1000.0;
-        msg_control.reference = (cmd / ratio);
-
-        // reference command F <-> _FEEDBK [pag. 244]
-        double vel = boost::lexical_cast<double>(fields[2]) * max_rpm / 1000.0;
-        msg_control.feedback = (vel / ratio);
-        // Update velocity motor
-        velocity = (vel / ratio);
 
-        // reference command E <-> _LPERR [pag. 243]
-        double loop_error = boost::lexical_cast<double>(fields[3]) * max_rpm / 1000.0;
-        msg_control.loop_error = (loop_error / ratio);
+    // reference command FM <-> _MOTFLAG [pag. 246]
+    unsigned char status = frame.value[FIELD_FLAGS];
+    memcpy(&_status, &status, sizeof(status));
+
+    // reference command M <-> _MOTCMD [pag. 250]
+    double cmd = frame.value[FIELD_COMMAND] * max_rpm / 1000.0;
+    msg_control.reference = (cmd / ratio);
+
+    // reference command F <-> _FEEDBK [pag. 244]
+    double vel = frame.value[FIELD_FEEDBACK] * max_rpm / 1000.0;
+    msg_control.feedback = (vel / ratio);
+    // Update velocity motor
+    velocity = (vel / ratio);
+
+    // reference command E <-> _LPERR [pag. 243]
+    double loop_error = frame.value[FIELD_LOOP_ERROR] * max_rpm / 1000.0;
+    msg_control.loop_error = (loop_error / ratio);
+
+    // reference command P <-> _MOTPWR [pag. 255]
+    msg_control.pwm = frame.value[FIELD_POWER];
+
+    // reference voltage V <-> _VOLTS [pag. ---]
+    msg_status.volts = frame.value[FIELD_VOLTS] / 10.0;
+
+    // reference command A <-> _MOTAMPS [pag. 230]
+    msg_status.amps_motor = frame.value[FIELD_AMPS] / 10.0;
+
+    // Evaluate effort
+    if(velocity != 0) effort = ((msg_status.volts * msg_status.amps_motor) / velocity) * ratio;
+    else effort = 0;
+
+    // reference command BA <-> _BATAMPS [pag. 233]
+    msg_status.amps_batt = frame.value[FIELD_BATTERY_AMPS] / 10.0;
+
+    // Reference command CR <-> _RELCNTR [pag. 241]
+    // To check and substitute with C
+    // Reference command C <-> _ABCNTR [pag. ---]
+    position = from_encoder_ticks(frame.value[FIELD_COUNTER]);
+
+    // reference command TR <-> _TR [pag. 260]
+    msg_status.track = frame.value[FIELD_TRACK];
+
+    //ROS_INFO_STREAM("[" << mNumber << "] track:" << msg_status.track);
+    //ROS_INFO_STREAM("[" << mNumber << "] volts:" << msg_status.volts << " - amps:" << msg_status.amps_motor);
+    //ROS_INFO_STREAM("[" << mNumber << "] status:" << status << " - pos:"<< position << " - vel:" << velocity << " - torque:");
+
+    // State for the diagnostics
+    motor_state_t state;
+    state.position = position;
+    state.velocity = velocity;
+    state.effort = effort;
+    state.pwm = msg_control.pwm;
+    state.loop_error = msg_control.loop_error;
+    state.volts = msg_status.volts;
+    state.amps_motor = msg_status.amps_motor;
+    state.amps_batt = msg_status.amps_batt;
+    state.track = msg_status.track;
+    state.status = _status;
+    _state.write(state);
 
-        // reference command P <-> _MOTPWR [pag. 255]
-        msg_control.pwm = boost::lexical_cast<double>(fields[4]);
-
-        // reference voltage V <-> _VOLTS [pag. ---]
-        msg_status.volts = boost::lexical_cast<double>(fields[5]) / 10;
-
-        // reference command A <-> _MOTAMPS [pag. 230]
-        msg_status.amps_motor = boost::lexical_cast<double>(fields[6]) / 10;
-
-        // Evaluate effort
-        if(velocity != 0) effort = ((msg_status.volts * msg_status.amps_motor) / velocity) * ratio;
-        else effort = 0;
-
-        // reference command BA <-> _BATAMPS [pag. 233]
-        msg_status.amps_motor = boost::lexical_cast<double>(fields[7]) / 10;
-
-        // Reference command CR <-> _RELCNTR [pag. 241]
-        // To check and substitute with C
-        // Reference command C <-> _ABCNTR [pag. ---]
-        position = from_encoder_ticks(boost::lexical_cast<double>(fields[8]));
-
-        // reference command TR <-> _TR [pag. 260]
-        msg_status.track = boost::lexical_cast<long>(fields[9]);
-
-        //ROS_INFO_STREAM("[" << mNumber << "] track:" << msg_status.track);
-        //ROS_INFO_STREAM("[" << mNumber << "] volts:" << msg_status.volts << " - amps:" << msg_status.amps_motor);
-        //ROS_INFO_STREAM("[" << mNumber << "] status:" << status << " - pos:"<< position << " - vel:" << velocity << " - torque:");
-    }
-    catch (std::bad_cast& e)
-    {
-      ROS_WARN("Failure parsing feedback data. Dropping message.");
-      return;
-    }
     // Publish status motor
     pub_status.publish(msg_status);
     // Publish status control motor
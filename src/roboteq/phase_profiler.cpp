@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/phase_profiler.h"
+
+namespace roboteq
+{
+
+const int64_t phase_limits[phase_buckets] = {10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, INT64_MAX};
+
+const char *const phase_names[CYCLE_PHASES] = {"read", "read/telemetry", "read/gpio", "update", "write", "cycle"};
+
+phase_profiler::phase_profiler()
+{
+    for(size_t p = 0; p < CYCLE_PHASES; ++p)
+    {
+        _count[p] = 0;
+        _sum[p] = 0;
+        _max[p] = 0;
+        for(size_t i = 0; i < phase_buckets; ++i)
+        {
+            _buckets[p][i] = 0;
+        }
+    }
+}
+
+void phase_profiler::record(cycle_phase_t phase, uint64_t duration)
+{
+    int64_t usec = duration / 1000;
+    for(size_t i = 0; i < phase_buckets; ++i)
+    {
+        if(usec < phase_limits[i])
+        {
+            _buckets[phase][i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    _count[phase].fetch_add(1, std::memory_order_relaxed);
+    _sum[phase].fetch_add(duration, std::memory_order_relaxed);
+    // Only the control loop write the max, the collect can only reset it
+    if(duration > _max[phase].load(std::memory_order_relaxed))
+    {
+        _max[phase].store(duration, std::memory_order_relaxed);
+    }
+}
+
+void phase_profiler::collect(phase_stats_t *stats)
+{
+    for(size_t p = 0; p < CYCLE_PHASES; ++p)
+    {
+        stats[p].count = _count[p].exchange(0, std::memory_order_relaxed);
+        stats[p].sum = _sum[p].exchange(0, std::memory_order_relaxed);
+        stats[p].max = _max[p].exchange(0, std::memory_order_relaxed);
+        for(size_t i = 0; i < phase_buckets; ++i)
+        {
+            stats[p].buckets[i] = _buckets[p][i].exchange(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+}
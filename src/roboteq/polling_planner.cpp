@@ -0,0 +1,129 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/polling_planner.h"
+
+#include <algorithm>
+
+namespace roboteq {
+
+polling_planner::polling_planner()
+    : mBudget(0)
+{
+}
+
+size_t polling_planner::add(const std::string &name, const std::string &params, double rate, size_t reply_size)
+{
+    poll_entry_t entry;
+    entry.name = name;
+    entry.params = params;
+    // Type, query, parameters and separator "?V 2_"
+    entry.tx_size = 1 + name.size() + (params.empty() ? 0 : params.size() + 1) + 1;
+    // Reply "V=245\r"
+    entry.rx_size = name.size() + 1 + reply_size + 1;
+    entry.enabled = true;
+    entry.next = 0;
+    entry.stamp = 0;
+    mEntries.push_back(entry);
+    setRate(mEntries.size() - 1, rate);
+    return mEntries.size() - 1;
+}
+
+void polling_planner::setRate(size_t index, double rate)
+{
+    mEntries[index].period = (rate > 0) ? static_cast<uint64_t>(1e9 / rate) : 0;
+}
+
+void polling_planner::enable(size_t index, bool enabled)
+{
+    mEntries[index].enabled = enabled;
+}
+
+void polling_planner::setBudget(size_t bytes)
+{
+    mBudget = bytes;
+}
+
+size_t polling_planner::reserved() const
+{
+    size_t tx = 0, rx = 0;
+    for(size_t i = 0; i < mEntries.size(); ++i)
+    {
+        if(mEntries[i].enabled && mEntries[i].period == 0)
+        {
+            tx += mEntries[i].tx_size;
+            rx += mEntries[i].rx_size;
+        }
+    }
+    return std::max(tx, rx);
+}
+
+void polling_planner::plan(uint64_t now, std::vector<size_t> &batch, size_t credit)
+{
+    batch.clear();
+    // All queries due
+    for(size_t i = 0; i < mEntries.size(); ++i)
+    {
+        if(mEntries[i].enabled && mEntries[i].next <= now)
+            batch.push_back(i);
+    }
+    // The queries of every cycle first, then the most late
+    std::stable_sort(batch.begin(), batch.end(), [this](size_t a, size_t b) {
+        if((mEntries[a].period == 0) != (mEntries[b].period == 0))
+            return mEntries[a].period == 0;
+        return mEntries[a].next < mEntries[b].next;
+    });
+    // The queries of every cycle are reserved ahead of the budget, the others share the bytes left.
+    // At least one of the others every cycle
+    size_t budget = mBudget + credit;
+    size_t tx = 0, rx = 0, selected = 0, others = 0;
+    for(size_t n = 0; n < batch.size(); ++n)
+    {
+        poll_entry_t &entry = mEntries[batch[n]];
+        if(entry.period > 0)
+        {
+            if(others > 0 && (tx + entry.tx_size > budget || rx + entry.rx_size > budget))
+                continue;
+            others++;
+        }
+        tx += entry.tx_size;
+        rx += entry.rx_size;
+        batch[selected++] = batch[n];
+        // Schedule the next poll, a query late is not repeated to recover the periods lost
+        entry.next += entry.period;
+        if(entry.next <= now)
+            entry.next = now + entry.period;
+    }
+    batch.resize(selected);
+    // Keep the order of the plan in the line
+    std::sort(batch.begin(), batch.end());
+}
+
+}
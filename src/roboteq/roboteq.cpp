@@ -28,12 +28,31 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-
 #include "roboteq/roboteq.h"
 
+#include <cstdlib>
+#include <cmath>
+
 namespace roboteq
 {
 
+// Telemetry queries in the order of the frame fields
+std::vector<query_t> telemetryQueries()
+{
+    std::vector<query_t> queries;
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+    {
+        queries.push_back(query_t(telemetry_query[n][0], telemetry_query[n][1]));
+    }
+    return queries;
+}
+
+const std::vector<query_t> telemetry = telemetryQueries();
+// Margin in ms of the serial watchdog over two control periods: round trip and scheduling
+const int watchdog_margin(100);
+// Largest serial watchdog of the board in ms [pag. 330]
+const int watchdog_max(65000);
+
 Roboteq::Roboteq(const ros::NodeHandle &nh, const ros::NodeHandle &private_nh, serial_controller *serial)
     : DiagnosticTask("Roboteq")
     , mNh(nh)
@@ -44,6 +63,33 @@ Roboteq::Roboteq(const ros::NodeHandle &nh, const ros::NodeHandle &private_nh, s
     setup_controller = false;
     // Initialize GPIO reading
     _isGPIOreading = false;
+    // Telemetry stream period in ms, zero polling mode
+    private_mNh.param<int>("telemetry_period", _stream_period, 0);
+    // Serial traffic in a dedicated thread, the control loop only exchange buffers
+    private_mNh.param<bool>("io_thread", _io_enable, false);
+    double control_frequency, io_frequency;
+    private_mNh.param<double>("control_frequency", control_frequency, 1.0);
+    private_mNh.param<double>("io_frequency", io_frequency, control_frequency);
+    _io_period = 1.0 / io_frequency;
+    _control_period = 1.0 / control_frequency;
+    // A single command for both channels in the same control tick
+    private_mNh.param<bool>("combined_command", _combined_command, true);
+    // Commands sent only when change or to keep alive the watchdog
+    private_mNh.param<int>("command/deadband", _deadband, 0);
+    private_mNh.param<int>("command/watchdog", _watchdog, 500);
+    // Timeline of the serial transactions and of the control cycle, started from the service
+    private_mNh.param<string>("trace/file", _trace_file, "/tmp/roboteq_trace.json");
+    private_mNh.param<int>("trace/events", _trace_events, 1 << 18);
+    _last_mailbox = command_mailbox_t();
+    _last_tx_size = 0;
+    _last_tx_time = 0;
+    _keepalive = 0;
+    _poll_credit = 0;
+    _commands_sent = 0;
+    _commands_suppressed = 0;
+    _io_running = false;
+    // Rate of each field, the fields are polled in the I/O thread or in the control loop
+    setupPollingPlan(_io_enable ? io_frequency : control_frequency);
     // Load default configuration roboteq board
     getRoboteqInformation();
 
@@ -112,11 +158,62 @@ Roboteq::Roboteq(const ros::NodeHandle &nh, const ros::NodeHandle &private_nh, s
         _param_encoder.push_back(new GPIOEncoderConfigurator(private_mNh, serial, mMotor, "/InOut", i+1));
     }
 
+    // Number of channels to decode
+    _channels = 0;
+    for(size_t i = 0; i < mMotor.size(); ++i)
+    {
+        _channels = std::max(_channels, (size_t) mMotor[i]->mNumber);
+    }
+    if(_channels > max_channels)
+    {
+        ROS_ERROR_STREAM("The board has maximum " << max_channels << " channels");
+        _channels = max_channels;
+    }
+    _snapshot = telemetry_snapshot_t();
+    _io_snapshot = telemetry_snapshot_t();
+    _stream_snapshot = telemetry_snapshot_t();
+    _poll_board = board_status_t();
+    _status_age = 0;
+
+    // Black box of the telemetry, size in MB, empty file to disable
+    string flight_file;
+    int flight_size;
+    private_mNh.param<string>("flight/file", flight_file, "roboteq_flight.rec");
+    private_mNh.param<int>("flight/size", flight_size, 16);
+    if(!flight_file.empty())
+    {
+        if(_flight.start(flight_file, static_cast<size_t>(flight_size) << 20))
+            ROS_INFO_STREAM("Flight recorder in " << flight_file);
+        else
+            ROS_WARN_STREAM("Flight recorder not started: " << _flight.error());
+    }
+    // Archive of the telemetry, the file is extended in every run
+    string archive_file;
+    private_mNh.param<string>("archive/file", archive_file, "");
+    if(!archive_file.empty())
+    {
+        if(_archive.start(archive_file))
+            ROS_INFO_STREAM("Telemetry archive in " << archive_file);
+        else
+            ROS_WARN_STREAM("Telemetry archive not started: " << _archive.error());
+    }
+
     // Add subscriber stop
     sub_stop = private_mNh.subscribe("emergency_stop", 1, &Roboteq::stop_Callback, this);
     // Initialize the peripheral publisher
     pub_peripheral = private_mNh.advertise<roboteq_control::Peripheral>("peripheral", 10,
                 boost::bind(&Roboteq::connectionCallback, this, _1), boost::bind(&Roboteq::connectionCallback, this, _1));
+    // Initialize the timing publisher, the limits of the buckets never change
+    pub_profile = private_mNh.advertise<roboteq_control::CycleProfile>("profile", 1);
+    for(size_t p = 0; p < CYCLE_PHASES; ++p)
+    {
+        msg_profile.phase.push_back(phase_names[p]);
+    }
+    for(size_t i = 0; i < phase_buckets - 1; ++i)
+    {
+        msg_profile.limits.push_back(phase_limits[i]);
+    }
+    msg_profile.limits.push_back(UINT32_MAX);
 
 }
 
@@ -146,21 +243,34 @@ void Roboteq::stop_Callback(const std_msgs::Bool::ConstPtr& msg)
 
 void Roboteq::getRoboteqInformation()
 {
-    // Load model roboeq board
-    string trn = mSerial->getQuery("TRN");
+    // Load model roboeq board, the setup queries are retried as the parameters
+    string trn = mSerial->getQuery("TRN", "", PRIORITY_CONFIG);
     std::vector<std::string> fields;
     boost::split(fields, trn, boost::algorithm::is_any_of(":"));
     _type = fields[0];
-    _model = fields[1];
+    if(fields.size() > 1)
+    {
+        _model = fields[1];
+    }
+    else
+    {
+        ROS_WARN_STREAM("Model of the board not decoded from \"" << trn << "\"");
+    }
     // ROS_INFO_STREAM("Model " << _model);
     // Load firmware version
-    _version = mSerial->getQuery("FID");
+    _version = mSerial->getQuery("FID", "", PRIORITY_CONFIG);
     // Load UID
-    _uid = mSerial->getQuery("UID");
+    _uid = mSerial->getQuery("UID", "", PRIORITY_CONFIG);
 }
 
 Roboteq::~Roboteq()
 {
+    stopIOThread();
+    // Without the Ctrl+C handler the stream is still running: no frames from the reader
+    // thread after the files are closed
+    mSerial->stop();
+    _flight.stop();
+    _archive.stop();
     // ROS_INFO_STREAM("Script: " << script(false));
 }
 
@@ -241,6 +351,19 @@ void Roboteq::initializeInterfaces()
     /// Register interfaces
     registerInterface(&joint_state_interface);
     registerInterface(&velocity_joint_interface);
+
+    // Start the board side telemetry
+    if(_stream_period > 0)
+    {
+        startTelemetryStream();
+    }
+    // Serial watchdog and keep alive of the commands
+    setupWatchdog();
+    // Move the serial traffic out of the control loop
+    if(_io_enable)
+    {
+        startIOThread();
+    }
 }
 
 void Roboteq::initializeDiagnostic()
@@ -258,211 +381,519 @@ void Roboteq::updateDiagnostics()
 {
     ROS_DEBUG_STREAM("Update diagnostic");
 
+    // Last status polled with the telemetry
+    board_status_t board;
+    _board.read(board);
     // Scale factors as outlined in the relevant portions of the user manual, please
     // see mbs/script.mbs for URL and specific page references.
-    try
+    if(board.valid & (1 << BOARD_FAULT))
     {
         // Fault flag [pag. 245]
-        string fault_flag = mSerial->getQuery("FF");
-        unsigned char fault = boost::lexical_cast<unsigned int>(fault_flag);
+        unsigned char fault = board.value[BOARD_FAULT];
         memcpy(&_fault, &fault, sizeof(fault));
+    }
+    if(board.valid & (1 << BOARD_STATUS))
+    {
         // Status flag [pag. 247]
-        string status_flag = mSerial->getQuery("FS");
-        unsigned char status = boost::lexical_cast<unsigned int>(status_flag);
+        unsigned char status = board.value[BOARD_STATUS];
         memcpy(&_flag, &status, sizeof(status));
-        // power supply voltage
-        string supply_voltage_1 = mSerial->getQuery("V", "1");
-        _volts_internal = boost::lexical_cast<double>(supply_voltage_1) / 10;
-        string supply_voltage_3 = mSerial->getQuery("V", "3");
-        _volts_five = boost::lexical_cast<double>(supply_voltage_3) / 1000;
-        // temperature channels [pag. 259]
-        string temperature_1 = mSerial->getQuery("T", "1");
-        _temp_mcu = boost::lexical_cast<double>(temperature_1);
-        string temperature_2 = mSerial->getQuery("T", "2");
-        _temp_bridge = boost::lexical_cast<double>(temperature_2);
     }
-    catch (std::bad_cast& e)
+    // power supply voltage
+    if(board.valid & (1 << BOARD_VOLTS_INTERNAL))
+        _volts_internal = board.value[BOARD_VOLTS_INTERNAL] / 10.0;
+    if(board.valid & (1 << BOARD_VOLTS_FIVE))
+        _volts_five = board.value[BOARD_VOLTS_FIVE] / 1000.0;
+    // temperature channels [pag. 259]
+    if(board.valid & (1 << BOARD_TEMP_MCU))
+        _temp_mcu = board.value[BOARD_TEMP_MCU];
+    if(board.valid & (1 << BOARD_TEMP_BRIDGE))
+        _temp_bridge = board.value[BOARD_TEMP_BRIDGE];
+    // Age of the oldest field received
+    uint64_t now = monotonic_ns(), oldest = now;
+    for(size_t i = 0; i < BOARD_FIELDS; ++i)
     {
-      ROS_WARN("Failure parsing feedback data. Dropping message.");
-      return;
+        if(board.valid & (1 << i))
+            oldest = std::min(oldest, board.stamp[i]);
     }
+    _status_age = (now - oldest) / 1e9;
+    // Timing of the control cycle at the diagnostic rate
+    publishProfile();
 
     // Force update all diagnostic parts
     diagnostic_updater.force_update();
 }
 
-void Roboteq::read(const ros::Time& time, const ros::Duration& period) {
-    //ROS_DEBUG_STREAM("Get measure from Roboteq");
+void Roboteq::startTelemetryStream()
+{
+    clear_frames(_stream_snapshot.frames, max_channels);
+    // Register a callback for each query repeated from the board
+    for(size_t n = 0; n < telemetry.size(); ++n)
+    {
+        mSerial->addCallback([this, n](const boost::string_ref data) { streamCallback(n, data); }, telemetry[n].first);
+    }
+    // Arm the repeat buffer
+    if(mSerial->startStream(telemetry, _stream_period))
+    {
+        // Only the status fields are still polled
+        for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        {
+            _planner.enable(n, false);
+        }
+        ROS_INFO_STREAM("Telemetry stream every " << _stream_period << "ms");
+    }
+    else
+    {
+        ROS_WARN_STREAM("Telemetry stream not started, polling mode");
+    }
+}
 
-    std::vector<std::string> motors[mMotor.size()];
-    std::vector<std::string> fields;
+void Roboteq::streamCallback(size_t field, const boost::string_ref data)
+{
+    // A new frame start with the first query of the history buffer
+    if(field == 0)
+    {
+        clear_frames(_stream_snapshot.frames, _channels);
+    }
+    // Decode directly the data received
+    decode_status_t status = decode_field((telemetry_field_t) field, data, _stream_snapshot.frames, _channels);
+    if(status == DECODE_OK)
+    {
+        uint64_t stamp = monotonic_ns();
+        for(size_t i = 0; i < _channels; ++i)
+        {
+            _stream_snapshot.frames[i].stamp[field] = stamp;
+        }
+    }
+    else
+    {
+        ROS_DEBUG_STREAM("Decode " << telemetry[field].first << "=" << data << " error " << status);
+    }
+    // The frame is complete with the last query of the history buffer
+    if(field == telemetry.size() - 1)
+    {
+        _state.write(_stream_snapshot);
+        _flight.record(_stream_snapshot.frames, _channels);
+    }
+}
+
+void Roboteq::setupPollingPlan(double frequency)
+{
+    double rate;
+    // Telemetry fields, the index in the plan is the field
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+    {
+        private_mNh.param<double>(string("polling/") + telemetry_plan[n].key, rate, telemetry_plan[n].rate);
+        _planner.add(telemetry_query[n][0], telemetry_query[n][1], rate, telemetry_plan[n].reply_size);
+    }
+    // Status fields after the telemetry
+    for(size_t n = 0; n < BOARD_FIELDS; ++n)
+    {
+        private_mNh.param<double>(string("polling/") + board_plan[n].key, rate, board_plan[n].rate);
+        _planner.add(board_query[n][0], board_query[n][1], rate, board_plan[n].reply_size);
+    }
+    // Bytes available in a refresh, 10 bits for each byte
+    double utilization;
+    private_mNh.param<double>("polling/utilization", utilization, polling_utilization);
+    double line = polling_line(mSerial->getBaudrate(), frequency);
+    _planner.setBudget(static_cast<size_t>(line * utilization));
+    ROS_INFO_STREAM("Polling budget " << _planner.getBudget() << " bytes every " << 1000.0 / frequency << "ms");
+    // The fields of every cycle are polled ahead of the budget
+    size_t reserved = _planner.reserved();
+    if(reserved > line)
+    {
+        ROS_ERROR_STREAM("Polling: the fields of every cycle need " << reserved << " bytes, the serial port moves "
+                         << static_cast<size_t>(line) << " bytes every " << 1000.0 / frequency << "ms. Lower the frequency or raise serial_rate");
+    }
+    else if(reserved > _planner.getBudget())
+    {
+        ROS_WARN_STREAM("Polling: the fields of every cycle need " << reserved << " bytes, over the budget of "
+                        << _planner.getBudget() << " bytes (polling/utilization " << utilization << "). The other fields are polled one every cycle");
+    }
+}
 
-    // Read status motor
-    // motor status flags [pag. 246]
-    string str_status = mSerial->getQuery("FM");
-    // ROS_INFO_STREAM("FM=" << str_status);
-    boost::split(fields, str_status, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // motor command [pag. 250]
-    string str_motor = mSerial->getQuery("M");
-    // ROS_INFO_STREAM("M =" << str_motor);
-    boost::split(fields, str_motor, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // motor feedback [pag. 244]
-    string str_feedback = mSerial->getQuery("F");
-    //ROS_INFO_STREAM("F =" << str_feedback);
-    boost::split(fields, str_feedback, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // motor loop error [pag. 244]
-    string str_loop_error = mSerial->getQuery("E");
-    // ROS_INFO_STREAM("E =" << str_loop_error);
-    boost::split(fields, str_loop_error, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // motor power [pag. 255]
-    string str_motor_power = mSerial->getQuery("P");
-    // ROS_INFO_STREAM("P =" << str_motor_power);
-    boost::split(fields, str_motor_power, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // power supply voltage [pag. 262]
-    string str_voltage_supply = mSerial->getQuery("V", "2");
-    //ROS_INFO_STREAM("V2=" << str_voltage_supply);
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(str_voltage_supply);
-    }
-    // motor Amps [pag. 230]
-    string str_motor_amps = mSerial->getQuery("A");
-    //ROS_INFO_STREAM("A =" << str_motor_amps);
-    boost::split(fields, str_motor_amps, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // motor battery amps [pag. 233]
-    string str_motor_battery_amps = mSerial->getQuery("BA");
-    //ROS_INFO_STREAM("BA=" << str_motor_battery_amps);
-    boost::split(fields, str_motor_battery_amps, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // position encoder value [pag. 236]
-    string str_position_encoder_absolute = mSerial->getQuery("C");
-    //ROS_INFO_STREAM("C =" << str_position_encoder_absolute);
-    boost::split(fields, str_position_encoder_absolute, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // motor track [pag. 260]
-    string str_motor_track = mSerial->getQuery("TR");
-    //ROS_INFO_STREAM("TR=" << str_motor_track);
-    boost::split(fields, str_motor_track, boost::algorithm::is_any_of(":"));
-    for(int i = 0; i < fields.size(); ++i) {
-        motors[i].push_back(fields[i]);
-    }
-    // send list
-    for(int i = 0; i < mMotor.size(); ++i) {
-        //get number motor initialization
-        unsigned int idx = mMotor[i]->mNumber-1;
-        // Read and decode vector
-        mMotor[i]->readVector(motors[idx]);
-    }
-
-    // Read data from GPIO
-    if(_isGPIOreading)
-    {
-        msg_peripheral.header.stamp = ros::Time::now();
-        std::vector<std::string> fields;
-        // Get Pulse in status [pag. 256]
-        string pulse_in = mSerial->getQuery("PI");
-        boost::split(fields, pulse_in, boost::algorithm::is_any_of(":"));
-        // Clear msg list
-        msg_peripheral.pulse_in.clear();
-        for(int i = 0; i < fields.size(); ++i)
-        {
-            try
+void Roboteq::pollTelemetry(motor_frame_t *frames)
+{
+    // Select the fields due
+    _planner.plan(monotonic_ns(), _poll_batch, _poll_credit);
+    _poll_credit = 0;
+    if(_poll_batch.empty())
+        return;
+    _poll_queries.resize(_poll_batch.size());
+    for(size_t n = 0; n < _poll_batch.size(); ++n)
+    {
+        const poll_entry_t &entry = _planner.entry(_poll_batch[n]);
+        _poll_queries[n].first = entry.name;
+        _poll_queries[n].second = entry.params;
+    }
+    // Send all queries in one line and decode the replies in the frames
+    mSerial->batchQuery(_poll_queries, _telemetry_requests);
+    uint64_t stamp = monotonic_ns();
+    bool board_update = false;
+    for(size_t n = 0; n < _telemetry_requests.size(); ++n)
+    {
+        if(!_telemetry_requests[n]->received)
+            continue;
+        size_t index = _poll_batch[n];
+        boost::string_ref data(_telemetry_requests[n]->data);
+        decode_status_t status;
+        if(index < TELEMETRY_FIELDS)
+        {
+            status = decode_field((telemetry_field_t) index, data, frames, _channels);
+            for(size_t i = 0; status == DECODE_OK && i < _channels; ++i)
             {
-                msg_peripheral.pulse_in.push_back(boost::lexical_cast<unsigned int>(fields[i]));
+                frames[i].stamp[index] = stamp;
             }
-            catch (std::bad_cast& e)
+        }
+        else
+        {
+            size_t field = index - TELEMETRY_FIELDS;
+            status = decode_value(data, _poll_board.value[field]);
+            if(status == DECODE_OK)
             {
-                msg_peripheral.pulse_in.push_back(0);
+                _poll_board.valid |= (1 << field);
+                _poll_board.stamp[field] = stamp;
+                board_update = true;
             }
         }
-        // Get analog input values [pag. 231]
-        string analog = mSerial->getQuery("AI");
-        boost::split(fields, analog, boost::algorithm::is_any_of(":"));
-        // Clear msg list
-        msg_peripheral.analog.clear();
-        for(int i = 0; i < fields.size(); ++i)
+        if(status == DECODE_OK)
+        {
+            _planner.update(index, stamp);
+        }
+        else
+        {
+            ROS_DEBUG_STREAM("Decode " << _poll_queries[n].first << "=" << data << " error " << status);
+        }
+    }
+    // Share the new status with the diagnostic
+    if(board_update)
+    {
+        _board.write(_poll_board);
+    }
+}
+
+void Roboteq::sendCommands(const command_mailbox_t &mailbox)
+{
+    // Acknowledges of the previous cycle
+    for(size_t n = 0; n < _command_requests.size(); ++n)
+    {
+        if(mSerial->poll(_command_requests[n]) && !(_command_requests[n]->received && _command_requests[n]->status))
+        {
+            ROS_DEBUG_STREAM("Command " << n << " not acknowledged");
+            // The board could have an old command, send again
+            _last_mailbox.valid = 0;
+        }
+    }
+    // Suppress the commands inside the deadband of the last sent
+    uint64_t now = monotonic_ns();
+    bool changed = (mailbox.valid != _last_mailbox.valid) || (now - _last_tx_time >= _keepalive);
+    for(size_t idx = 0; !changed && idx < max_channels; ++idx)
+    {
+        if(!(mailbox.valid & (1 << idx)))
+            continue;
+        int32_t last = _last_mailbox.command[idx];
+        changed = (mailbox.mode[idx] != _last_mailbox.mode[idx])
+                || (std::abs((int64_t) mailbox.command[idx] - last) > _deadband)
+                // The stop is always exact
+                || (mailbox.command[idx] == 0 && last != 0);
+    }
+    if(!changed)
+    {
+        // The bytes not used are given to the polling in the next cycle
+        _poll_credit = _last_tx_size;
+        _commands_suppressed++;
+        return;
+    }
+    _last_mailbox = mailbox;
+    _last_tx_time = now;
+    _tx.clear();
+    // A single M command or a G command for each channel
+    format_commands(mailbox, _channels, _combined_command, _tx);
+    if(_tx.count() == 0)
+        return;
+    _tx.finish();
+    _last_tx_size = _tx.size();
+    _commands_sent++;
+    // One write, the acknowledges are checked in the next cycle
+    mSerial->asyncCommands(_tx, _command_requests);
+}
+
+void Roboteq::setupWatchdog()
+{
+    // The commands leave once every control period, the keep alive can not be faster than the control loop.
+    // The watchdog must cover two periods, a single command lost does not stop the motors
+    int period = static_cast<int>(std::ceil(_control_period * 1000.0));
+    int min_watchdog = std::min(2 * period + watchdog_margin, watchdog_max);
+    if(_watchdog > 0)
+    {
+        if(_watchdog < min_watchdog)
+        {
+            ROS_WARN_STREAM("Serial watchdog " << _watchdog << "ms too short for a control period of " << period << "ms, set to " << min_watchdog << "ms");
+            _watchdog = min_watchdog;
+        }
+        // Stop the motors if the commands are lost for more than the watchdog [pag. 330]
+        if(!mSerial->setParam("RWD", std::to_string(_watchdog)))
+        {
+            ROS_WARN_STREAM("Serial watchdog not configured");
+        }
+    }
+    else
+    {
+        // Keep the watchdog of the board
+        try
+        {
+            _watchdog = boost::lexical_cast<int>(mSerial->getParam("RWD"));
+        }
+        catch (std::bad_cast& e)
         {
-            try
+            _watchdog = 0;
+        }
+        if(_watchdog > 0 && _watchdog < min_watchdog)
+        {
+            ROS_WARN_STREAM("Serial watchdog of the board " << _watchdog << "ms shorter than " << min_watchdog << "ms, the motors stop between two control periods of " << period << "ms");
+        }
+    }
+    // Refresh the commands twice every watchdog, one second without watchdog.
+    // The refresh is checked in the control loop, at least one control period
+    double keepalive = std::max((_watchdog > 0) ? _watchdog / 2.0 : 1000.0, _control_period * 1000.0);
+    _keepalive = static_cast<uint64_t>(keepalive * 1e6);
+    ROS_INFO_STREAM("Serial watchdog " << _watchdog << "ms, commands refreshed every " << keepalive << "ms");
+}
+
+void Roboteq::startIOThread()
+{
+    _commands.write(command_mailbox_t());
+    _io_running = true;
+    _io_thread = std::thread(&Roboteq::ioLoop, this);
+    ROS_INFO_STREAM("I/O thread every " << _io_period * 1000.0 << "ms");
+}
+
+void Roboteq::stopIOThread()
+{
+    if(!_io_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lck(_io_mutex);
+        _io_running = false;
+    }
+    _io_cv.notify_one();
+    _io_thread.join();
+}
+
+void Roboteq::ioLoop()
+{
+    const std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(_io_period));
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    uint32_t last_command = _commands.sequence();
+    command_mailbox_t mailbox;
+    while(_io_running)
+    {
+        // Send the commands as soon as the control loop post them
+        uint32_t sequence = _commands.sequence();
+        if(sequence != last_command)
+        {
+            last_command = _commands.read(mailbox);
+            sendCommands(mailbox);
+        }
+        // Refresh the telemetry
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(now >= next)
+        {
+            pollTelemetry(_io_snapshot.frames);
+            // If the board is streaming the snapshot is published from the stream
+            if(!mSerial->isStreaming())
             {
-                msg_peripheral.analog.push_back(boost::lexical_cast<double>(fields[i]) / 1000.0);
+                _state.write(_io_snapshot);
+                _flight.record(_io_snapshot.frames, _channels);
             }
-            catch (std::bad_cast& e)
+            // Read data from GPIO
+            if(_isGPIOreading)
             {
-                msg_peripheral.analog.push_back(0);
+                readGPIO();
             }
+            // Skip the periods lost in a slow refresh
+            next = std::max(next + period, now);
         }
+        // Wait the next refresh or new commands
+        std::unique_lock<std::mutex> lck(_io_mutex);
+        _io_cv.wait_until(lck, next, [this, last_command] {
+            return !_io_running || _commands.sequence() != last_command;
+        });
+    }
+}
+
+void Roboteq::read(const ros::Time& time, const ros::Duration& period) {
+    //ROS_DEBUG_STREAM("Get measure from Roboteq");
+    phase_timer read_timer(_profiler, PHASE_READ);
 
-        // Get Digital input values [pag. 242]
-        string digital_in = mSerial->getQuery("DI");
-        boost::split(fields, digital_in, boost::algorithm::is_any_of(":"));
-        // Clear msg list
-        msg_peripheral.digital_in.clear();
-        for(int i = 0; i < fields.size(); ++i)
+    {
+        phase_timer telemetry_timer(_profiler, PHASE_READ_TELEMETRY);
+        if(_io_thread.joinable() || mSerial->isStreaming())
         {
-            try
-            {
-                msg_peripheral.digital_in.push_back(boost::lexical_cast<unsigned int>(fields[i]));
-            }
-            catch (std::bad_cast& e)
+            // Take the newest snapshot from the I/O thread or from the board
+            _state.read(_snapshot);
+        }
+        if(!_io_thread.joinable())
+        {
+            // Poll the fields due, only the status fields if the board is streaming
+            pollTelemetry(_snapshot.frames);
+            if(!mSerial->isStreaming())
+                _flight.record(_snapshot.frames, _channels);
+        }
+        // Send the frames to all motors
+        for(size_t i = 0; i < mMotor.size(); ++i)
+        {
+            //get number motor initialization
+            size_t idx = mMotor[i]->mNumber-1;
+            // Nothing received from the stream yet
+            if(idx < _channels && _snapshot.frames[idx].valid != 0)
             {
-                msg_peripheral.digital_in.push_back(0);
+                // Read and decode frame
+                mMotor[i]->readVector(_snapshot.frames[idx]);
+                _archive.append(idx, _snapshot.frames[idx]);
             }
         }
+    }
 
-        string digital_out = mSerial->getQuery("DO");
-        unsigned int num = 0;
+    // Read data from GPIO, the I/O thread read them in background
+    if(_isGPIOreading && !_io_thread.joinable())
+    {
+        phase_timer gpio_timer(_profiler, PHASE_READ_GPIO);
+        readGPIO();
+    }
+}
+
+void Roboteq::readGPIO()
+{
+    msg_peripheral.header.stamp = ros::Time::now();
+    std::vector<std::string> fields;
+    // Get Pulse in status [pag. 256]
+    string pulse_in = mSerial->getQuery("PI", "", PRIORITY_DIAGNOSTIC);
+    boost::split(fields, pulse_in, boost::algorithm::is_any_of(":"));
+    // Clear msg list
+    msg_peripheral.pulse_in.clear();
+    for(int i = 0; i < fields.size(); ++i)
+    {
+        try
+        {
+            msg_peripheral.pulse_in.push_back(boost::lexical_cast<unsigned int>(fields[i]));
+        }
+        catch (std::bad_cast& e)
+        {
+            msg_peripheral.pulse_in.push_back(0);
+        }
+    }
+    // Get analog input values [pag. 231]
+    string analog = mSerial->getQuery("AI", "", PRIORITY_DIAGNOSTIC);
+    boost::split(fields, analog, boost::algorithm::is_any_of(":"));
+    // Clear msg list
+    msg_peripheral.analog.clear();
+    for(int i = 0; i < fields.size(); ++i)
+    {
         try
         {
-            num = boost::lexical_cast<unsigned int>(digital_out);
+            msg_peripheral.analog.push_back(boost::lexical_cast<double>(fields[i]) / 1000.0);
         }
         catch (std::bad_cast& e)
         {
-            num = 0;
+            msg_peripheral.analog.push_back(0);
+        }
+    }
+
+    // Get Digital input values [pag. 242]
+    string digital_in = mSerial->getQuery("DI", "", PRIORITY_DIAGNOSTIC);
+    boost::split(fields, digital_in, boost::algorithm::is_any_of(":"));
+    // Clear msg list
+    msg_peripheral.digital_in.clear();
+    for(int i = 0; i < fields.size(); ++i)
+    {
+        try
+        {
+            msg_peripheral.digital_in.push_back(boost::lexical_cast<unsigned int>(fields[i]));
         }
-        int mask = 0x0;
-        // Clear msg list
-        msg_peripheral.digital_out.clear();
-        for(int i = 0; i < 8; ++i)
+        catch (std::bad_cast& e)
         {
-            msg_peripheral.digital_out.push_back((mask & num));
-            mask <<= 1;
+            msg_peripheral.digital_in.push_back(0);
         }
+    }
+
+    string digital_out = mSerial->getQuery("DO", "", PRIORITY_DIAGNOSTIC);
+    unsigned int num = 0;
+    try
+    {
+        num = boost::lexical_cast<unsigned int>(digital_out);
+    }
+    catch (std::bad_cast& e)
+    {
+        num = 0;
+    }
+    int mask = 0x0;
+    // Clear msg list
+    msg_peripheral.digital_out.clear();
+    for(int i = 0; i < 8; ++i)
+    {
+        msg_peripheral.digital_out.push_back((mask & num));
+        mask <<= 1;
+    }
 
-        // Send GPIO status
-        pub_peripheral.publish(msg_peripheral);
+    // Send GPIO status
+    pub_peripheral.publish(msg_peripheral);
+}
+
+void Roboteq::publishProfile()
+{
+    phase_stats_t stats[CYCLE_PHASES];
+    // Always collect, the next message start from here
+    _profiler.collect(stats);
+    if(pub_profile.getNumSubscribers() == 0)
+        return;
+    msg_profile.header.stamp = ros::Time::now();
+    msg_profile.count.clear();
+    msg_profile.mean.clear();
+    msg_profile.max.clear();
+    msg_profile.buckets.clear();
+    for(size_t p = 0; p < CYCLE_PHASES; ++p)
+    {
+        msg_profile.count.push_back(stats[p].count);
+        msg_profile.mean.push_back(stats[p].count > 0 ? stats[p].sum / 1000.0 / stats[p].count : 0.0);
+        msg_profile.max.push_back(stats[p].max / 1000.0);
+        for(size_t i = 0; i < phase_buckets; ++i)
+        {
+            msg_profile.buckets.push_back(stats[p].buckets[i]);
+        }
     }
+    pub_profile.publish(msg_profile);
 }
 
 void Roboteq::write(const ros::Time& time, const ros::Duration& period) {
     //ROS_DEBUG_STREAM("Write command to Roboteq");
+    phase_timer write_timer(_profiler, PHASE_WRITE);
 
-    for (vector<Motor*>::iterator it = mMotor.begin() ; it != mMotor.end(); ++it)
+    // Commands of all channels
+    command_mailbox_t mailbox;
+    mailbox.valid = 0;
+    for(size_t i = 0; i < mMotor.size(); ++i)
     {
-        Motor* motor = ((Motor*)(*it));
-        // Launch initialization motors
-        motor->writeCommandsToHardware(period);
-        ROS_DEBUG_STREAM("Motor [" << motor->getName() << "] Send commands");
+        size_t idx = mMotor[i]->mNumber-1;
+        if(idx >= _channels)
+            continue;
+        mailbox.command[idx] = mMotor[i]->buildCommand(period);
+        mailbox.mode[idx] = mMotor[i]->getControlMode();
+        mailbox.valid |= (1 << idx);
+    }
+
+    if(_io_thread.joinable())
+    {
+        // Post the commands to the I/O thread
+        _commands.write(mailbox);
+        // Empty critical section, the I/O thread can't miss the wake up between the check and the wait
+        {
+            std::lock_guard<std::mutex> lck(_io_mutex);
+        }
+        _io_cv.notify_one();
+    }
+    else
+    {
+        sendCommands(mailbox);
     }
 }
 
@@ -534,6 +965,10 @@ void Roboteq::run(diagnostic_updater::DiagnosticStatusWrapper &stat)
 
     stat.add("Internal (V)", _volts_internal);
     stat.add("5v regulator (V)", _volts_five);
+    stat.add("Status age (s)", _status_age);
+    stat.add("Polling budget (bytes)", _planner.getBudget());
+    stat.add("Polling reserved (bytes)", _planner.reserved());
+    stat.addf("Commands", "sent %lu suppressed %lu", _commands_sent.load(), _commands_suppressed.load());
 
     string mode = "[ ";
     if(_flag.serial_mode)
@@ -547,11 +982,37 @@ void Roboteq::run(diagnostic_updater::DiagnosticStatusWrapper &stat)
     stat.add("Mode", mode);
     // Spectrum
     stat.add("Spectrum", (bool)_flag.spectrum);
+    // Traffic of each priority class on the serial port
+    for(size_t i = 0; i < PRIORITY_CLASSES; ++i)
+    {
+        class_stats_t traffic = mSerial->getStats((priority_t) i);
+        stat.addf(string("Queue ") + priority_name((priority_t) i), "depth %lu (max %lu) wait %.0fus (max %.0fus) lines %lu",
+                  (unsigned long) traffic.depth, (unsigned long) traffic.max_depth, traffic.wait_mean, traffic.wait_max, (unsigned long) traffic.lines);
+    }
+    // Round trip time of the serial link
+    link_stats_t link = mSerial->getLinkStats();
+    stat.addf("Link RTT", "%.2fms (var %.2fms) timeout %.2fms", link.srtt / 1000.0, link.rttvar / 1000.0, link.rto / 1000.0);
+    stat.addf("Link errors", "timeouts %lu retries %lu reconnects %lu", (unsigned long) link.timeouts, (unsigned long) link.retries, (unsigned long) link.reconnects);
+    // Latency of each mnemonic
+    std::vector<latency_summary_t> latency;
+    mSerial->getLatency().summary(latency);
+    for(size_t i = 0; i < latency.size(); ++i)
+    {
+        const latency_summary_t &item = latency[i];
+        stat.addf("Latency " + item.name, "p50 %.2fms p99 %.2fms p99.9 %.2fms max %.2fms n %lu retries %lu timeouts %lu",
+                  item.p50 / 1000.0, item.p99 / 1000.0, item.p999 / 1000.0, item.max / 1000.0,
+                  (unsigned long) item.count, (unsigned long) item.retries, (unsigned long) item.timeouts);
+    }
     // Microbasic
     stat.add("Micro basic running", (bool)_flag.microbasic_running);
 
     stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Board ready!");
 
+    if(link.degraded)
+    {
+        stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::ERROR, "Serial link degraded");
+    }
+
     if(_flag.power_stage_off)
     {
         stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Power stage OFF");
@@ -774,6 +1235,27 @@ bool Roboteq::service_Callback(roboteq_control::Service::Request &req, roboteq_c
         // return message
         msg.information = "System reset";
     }
+    else if(req.service.compare("latency") == 0)
+    {
+        // Percentiles of each mnemonic
+        msg.information = mSerial->getLatency().dump();
+    }
+    else if(req.service.compare("trace") == 0)
+    {
+        trace_recorder &recorder = trace_recorder::instance();
+        if(!trace_recorder::enabled())
+        {
+            recorder.start(_trace_events);
+            msg.information = "Trace started, call again to save in " + _trace_file;
+        }
+        else
+        {
+            recorder.stop();
+            long events = recorder.save(_trace_file);
+            msg.information = (events >= 0) ? "Trace saved in " + _trace_file + " - " + std::to_string(events) + " events"
+                                            : "Unable to save the trace in " + _trace_file;
+        }
+    }
     else if(req.service.compare("save") == 0)
     {
         // Launch reset command
@@ -787,6 +1269,8 @@ bool Roboteq::service_Callback(roboteq_control::Service::Request &req, roboteq_c
                           "* info      - information about this board \n"
                           "* reset     - " + _model + " board software reset\n"
                           "* save      - Save all paramters in EEPROM \n"
+                          "* latency   - latency of each command and query \n"
+                          "* trace     - start and save a timeline of the serial and control loop \n"
                           "* help      - this help.";
     }
     return true;
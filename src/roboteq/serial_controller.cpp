@@ -29,22 +29,45 @@
  */
 
 #include "roboteq/serial_controller.h"
+#include "roboteq/trace_recorder.h"
 
-#include <regex>
+#include <algorithm>
 
 namespace roboteq {
 
 const std::string eol("\r");
 const size_t max_line_length(128);
-const std::regex rgx_query("(.+)=(.+)\r");
-const std::regex rgx_cmd("(\\+|-)\r");
+// Maximum number of requests in flight
+const size_t max_in_flight(16);
+// Default attempts of a transaction for each priority class.
+// A command or a feedback is stale after a control period, the next loop send a new one.
+// The one-shot queries and commands of the setup are sent as PRIORITY_CONFIG to be retried
+const unsigned int retry_budget[PRIORITY_CLASSES] = {5, 1, 1, 2, 3};
+// Period in ms between two attempts to open the serial port after an error
+const int reconnect_period(500);
 
 serial_controller::serial_controller(string port, unsigned long baudrate)
-    : mSerialPort(port)
+    : serial_controller(make_transport(port, baudrate), baudrate)
+{
+    mSerialPort = port;
+}
+
+serial_controller::serial_controller(transport* link, unsigned long baudrate)
+    : mSerial(link)
+    , mSerialPort("transport")
     , mBaudrate(baudrate)
+    , mScheduler(baudrate)
 {
     // Default timeout
     mTimeout = 500;
+    mStopping = false;
+    // Stream disabled
+    mStreamCursor = 0;
+    mReserved = 0;
+    // Bound the wait of a write on the time of the line
+    mSerial->setLineRate(baudrate);
+    // Attempts of the transactions
+    std::copy(retry_budget, retry_budget + PRIORITY_CLASSES, mRetryBudget);
 }
 
 serial_controller::~serial_controller()
@@ -54,29 +77,18 @@ serial_controller::~serial_controller()
 
 bool serial_controller::start()
 {
-    try
-    {
-        mSerial.setPort(mSerialPort);
-        mSerial.open();
-        mSerial.setBaudrate(mBaudrate);
-
-        serial::Timeout to = serial::Timeout::simpleTimeout(mTimeout);
-        mSerial.setTimeout(to);
-    }
-    catch (serial::IOException& e)
+    if(!mSerial->open())
     {
-        ROS_ERROR_STREAM("Unable to open serial port " << mSerialPort << " - Error: "  << e.what() );
+        ROS_ERROR_STREAM("Unable to open serial port " << mSerialPort << " - Error: "  << mSerial->error() );
         return false;
     }
-
-    if(mSerial.isOpen()){
-        ROS_DEBUG_STREAM("Serial Port correctly initialized: " << mSerialPort );
-    }
-    else
+    // The emulator of the board is connected to the slave side
+    pty_transport* pty = dynamic_cast<pty_transport*>(mSerial.get());
+    if(pty != NULL)
     {
-        ROS_ERROR_STREAM( "Serial port not opened: " << mSerialPort );
-        return false;
+        ROS_INFO_STREAM("Pseudo terminal ready: " << pty->slaveName());
     }
+    ROS_DEBUG_STREAM("Serial Port correctly initialized: " << mSerialPort );
     // Initialize stop function
     mStopping = false;
     // Launch async reader thread
@@ -115,15 +127,35 @@ bool serial_controller::start()
 
 bool serial_controller::stop()
 {
+    // Already stopped
+    if(!first.joinable() && !mSerial->isOpen())
+        return true;
+    // Stop the telemetry stream
+    if(isStreaming())
+        stopStream();
     // Stop script
     script(false);
     // Stop the reader
     mStopping = true;
-    // Close the serial port
-    mSerial.close();
+    mSerial->interrupt();
     // Wait stop thread
-    first.join();
+    if(first.joinable())
+        first.join();
+    // Close the serial port
+    mSerial->close();
+    mCapture.stop();
+    return true;
+}
 
+bool serial_controller::startCapture(const string &path, size_t size)
+{
+    if(!mCapture.start(path, size))
+    {
+        ROS_ERROR_STREAM("Unable to start the capture - Error: " << mCapture.error());
+        return false;
+    }
+    ROS_INFO_STREAM("Capture of the serial port in " << path);
+    return true;
 }
 
 bool serial_controller::addCallback(const callback_data_t &callback, const string data)
@@ -140,21 +172,24 @@ bool serial_controller::addCallback(const callback_data_t &callback, const strin
 
 bool serial_controller::enableDownload()
 {
-    mWriteMutex.lock();
+    mScheduler.acquire(PRIORITY_CONFIG, 16);
     // Send SLD.
     ROS_INFO("Commanding driver to enter download mode.");
     // Set fals HLD mode
     isHLD = false;
     // Send enable write mode
-    mSerial.write("%SLD 321654987" + eol);
+    string sld = "%SLD 321654987" + eol;
+    mCapture.record(CAPTURE_TX, sld.data(), sld.size());
+    mSerial->write(sld);
     // Set lock variable and wait a data to return
     std::unique_lock<std::mutex> lck(mReaderMutex);
     // TODO change timeout
     cv.wait_for(lck, std::chrono::seconds(1));
     // Look for special ack from SLD.
     // ROS_INFO_STREAM("HLD=" << isHLD);
-    // Unlock mutex
-    mWriteMutex.unlock();
+    // Free the serial port
+    lck.unlock();
+    mScheduler.release();
     // If not received return false
     if(!isHLD)
         return false;
@@ -187,139 +222,531 @@ bool serial_controller::downloadScript()
     return false;
 }
 
-bool serial_controller::command(string msg, string params, string type)
+request_ptr serial_controller::newRequest(string name, uint64_t mnemonic)
+{
+    request_ptr request = std::make_shared<request_t>();
+    // The reader thread copy the data without allocations
+    request->data.reserve(max_line_length);
+    resetRequest(request, name, mnemonic);
+    return request;
+}
+
+void serial_controller::resetRequest(const request_ptr &request, const string &name, uint64_t mnemonic)
+{
+    request->name = name;
+    request->mnemonic = mnemonic;
+    request->done = false;
+    request->received = false;
+    request->status = false;
+    request->attempt = 0;
+    request->bytes = 0;
+    request->data.clear();
+}
+
+priority_t serial_controller::classify(const string &msg, const string &type)
+{
+    if(type.compare("!") == 0)
+    {
+        // Emergency stop and release [pag. 203]
+        if(msg.compare("EX") == 0 || msg.compare("MG") == 0)
+            return PRIORITY_ESTOP;
+        return PRIORITY_COMMAND;
+    }
+    if(type.compare("?") == 0)
+        return PRIORITY_FEEDBACK;
+    // Parameters and maintenance
+    return PRIORITY_CONFIG;
+}
+
+void serial_controller::transmit(const vector<request_ptr> &requests, const char* line, size_t size, priority_t priority, unsigned int attempt)
+{
+    // The emergency stop does not wait a free place in the reply queue
+    size_t reserved = (priority == PRIORITY_ESTOP) ? 0 : requests.size();
+    if(reserved > 0)
+    {
+        // Reserve the places for all requests before the turn, the grant is never held waiting the replies
+        std::unique_lock<std::mutex> lck(mReaderMutex);
+        // A place is free at the latest when the requests in flight are on the line and then expire
+        size_t inflight = 0;
+        for(deque<request_ptr>::const_iterator it = mPending.begin(); it != mPending.end(); ++it)
+        {
+            inflight += (*it)->bytes;
+        }
+        std::chrono::steady_clock::duration bound = mLink.timeout(attempt)
+                + std::chrono::microseconds(inflight * 10000000ULL / mBaudrate);
+        if(!mWindow.wait_for(lck, bound, [this, reserved]{
+            return (mPending.empty() && mReserved == 0) || (mPending.size() + mReserved + reserved <= max_in_flight); }))
+        {
+            // Never over the requests in flight, the requests fail without writing
+            ROS_WARN_STREAM("Serial port " << mSerialPort << " reply queue full, line not sent");
+            for(vector<request_ptr>::const_iterator it = requests.begin(); it != requests.end(); ++it)
+            {
+                (*it)->done = true;
+                lost(*it);
+            }
+            return;
+        }
+        mReserved += reserved;
+    }
+    // Wait the turn of the class, keep the same order between the serial port and the reply queue
+    mScheduler.acquire(priority, size);
+    {
+        std::unique_lock<std::mutex> lck(mReaderMutex);
+        mReserved -= reserved;
+        // The deadline cover the transmission of the line and the round trip estimated
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration deadline = mLink.timeout(attempt)
+                + std::chrono::microseconds(size * 10000000ULL / mBaudrate);
+        for(vector<request_ptr>::const_iterator it = requests.begin(); it != requests.end(); ++it)
+        {
+            (*it)->attempt = attempt;
+            (*it)->bytes = std::max<size_t>(size / requests.size(), 1);
+            (*it)->sent = now;
+            (*it)->deadline = now + deadline;
+        }
+        mPending.insert(mPending.end(), requests.begin(), requests.end());
+        for(vector<request_ptr>::const_iterator it = requests.begin(); it != requests.end(); ++it)
+        {
+            ROBOTEQ_TRACE(enqueue, (*it)->mnemonic, reinterpret_cast<uintptr_t>(it->get()));
+        }
+    }
+    ROS_DEBUG_STREAM("TX: " << boost::string_ref(line, size));
+    mCapture.record(CAPTURE_TX, line, size);
+    ROBOTEQ_TRACE(write, size, 0);
+    if(!mSerial->write(line, size))
+    {
+        ROS_ERROR_STREAM("Serial port " << mSerialPort << " - Error: " << mSerial->error());
+        // The line is not on the wire: the requests fail now and count as failures of the link
+        std::lock_guard<std::mutex> lck(mReaderMutex);
+        for(vector<request_ptr>::const_iterator it = requests.begin(); it != requests.end(); ++it)
+        {
+            deque<request_ptr>::iterator pending = std::find(mPending.begin(), mPending.end(), *it);
+            if(pending == mPending.end())
+                continue;
+            mPending.erase(pending);
+            (*it)->done = true;
+            (*it)->cv.notify_all();
+            lost(*it);
+        }
+        mWindow.notify_all();
+    }
+    // Grant the next line
+    mScheduler.release();
+}
+
+request_ptr serial_controller::send(string msg, string params, string type, bool query, priority_t priority, unsigned int attempt)
 {
-    // Lock the write mutex
-    mWriteMutex.lock();
+    // Commands receive only "+" or "-"
+    request_ptr request = newRequest(query ? msg : "", mnemonic_key(msg));
     // Build the string
     string msg2;
-    //mwh update - add ! as type for action command
-    if (type.compare("") == 0) type = "!";
-    
     if(params.compare("") == 0) {
         msg2 = type + msg + eol;
     } else {
         msg2 = type + msg + " " + params + eol;
     }
+    if(priority == PRIORITY_AUTO) priority = classify(msg, type);
+    transmit(vector<request_ptr>(1, request), msg2, priority, attempt);
+    return request;
+}
+
+void serial_controller::asyncBatch(const vector<query_t> &queries, vector<request_ptr> &requests, string type, priority_t priority)
+{
+    requests.resize(queries.size());
+    // Build a single line, the commands are separated with "_" [pag. 179]
+    string line;
+    for(size_t i = 0; i < queries.size(); ++i)
+    {
+        if(!line.empty()) line += "_";
+        line += type + queries[i].first;
+        if(!queries[i].second.empty()) line += " " + queries[i].second;
+        // Reuse the requests already completed
+        if(requests[i])
+            resetRequest(requests[i], queries[i].first, mnemonic_key(queries[i].first));
+        else
+            requests[i] = newRequest(queries[i].first, mnemonic_key(queries[i].first));
+    }
+    line += eol;
+    if(priority == PRIORITY_AUTO) priority = classify("", type);
+    transmit(requests, line, priority);
+}
+
+void serial_controller::asyncCommands(const tx_buffer &line, vector<request_ptr> &requests, priority_t priority)
+{
+    requests.resize(line.count());
+    // The mnemonics follow the type of each command "!G 1 100_!G 2 -100"
+    boost::string_ref commands(line.data(), line.size());
+    for(size_t i = 0; i < requests.size(); ++i)
+    {
+        size_t end = std::min(commands.find('_'), commands.size());
+        uint64_t mnemonic = (end > 1) ? mnemonic_key(commands.substr(1, end - 1)) : 0;
+        commands.remove_prefix(std::min(end + 1, commands.size()));
+        // Reuse the requests already closed, the others are still in the reply queue
+        if(requests[i] && poll(requests[i]))
+            resetRequest(requests[i], "", mnemonic);
+        else
+            requests[i] = newRequest("", mnemonic);
+    }
+    transmit(requests, line.data(), line.size(), priority);
+}
+
+vector<request_ptr> serial_controller::asyncBatch(const vector<query_t> &queries, string type, priority_t priority)
+{
+    vector<request_ptr> requests;
+    asyncBatch(queries, requests, type, priority);
+    return requests;
+}
+
+bool serial_controller::batchQuery(const vector<query_t> &queries, vector<request_ptr> &requests, priority_t priority)
+{
+    asyncBatch(queries, requests, "?", priority);
+    bool status = true;
+    // Wait all replies
+    for(size_t i = 0; i < requests.size(); ++i)
+    {
+        status &= wait(requests[i]);
+    }
+    return status;
+}
+
+bool serial_controller::batchQuery(const vector<query_t> &queries, vector<string> &frame)
+{
+    vector<request_ptr> requests;
+    bool status = batchQuery(queries, requests, PRIORITY_CONFIG);
+    frame.resize(requests.size());
+    // Collect all replies in the frame
+    for(size_t i = 0; i < requests.size(); ++i)
+    {
+        frame[i] = requests[i]->data;
+    }
+    return status;
+}
+
+bool serial_controller::startStream(const vector<query_t> &queries, unsigned int period)
+{
+    // Clear the history buffer
+    stopStream();
+    // Fill the history buffer with all queries
+    vector<string> frame;
+    if(!batchQuery(queries, frame))
+        return false;
+    {
+        std::lock_guard<std::mutex> lck(mReaderMutex);
+        mStream.clear();
+        for(vector<query_t>::const_iterator it = queries.begin(); it != queries.end(); ++it)
+        {
+            mStream.push_back(it->first);
+        }
+        mStreamCursor = 0;
+    }
+    // Repeat the history buffer every period
+    transmit(vector<request_ptr>(), "# " + std::to_string(period) + eol, PRIORITY_CONFIG);
+    return true;
+}
+
+void serial_controller::stopStream()
+{
+    {
+        std::lock_guard<std::mutex> lck(mReaderMutex);
+        mStream.clear();
+    }
+    // Stop the repeat and clear the history buffer
+    transmit(vector<request_ptr>(), "# C" + eol, PRIORITY_CONFIG);
+}
+
+bool serial_controller::streamNext(const boost::string_ref &name)
+{
+    std::lock_guard<std::mutex> lck(mReaderMutex);
+    if(mStream.empty())
+        return false;
+    // Resync on the first message of the stream
+    if(boost::string_ref(mStream[mStreamCursor]) != name)
+    {
+        if(boost::string_ref(mStream[0]) != name)
+            return false;
+        mStreamCursor = 0;
+    }
+    mStreamCursor = (mStreamCursor + 1) % mStream.size();
+    return true;
+}
+
+void serial_controller::expire(const request_ptr &request)
+{
+    // Remove the request from the reply queue
+    deque<request_ptr>::iterator it = std::find(mPending.begin(), mPending.end(), request);
+    if(it != mPending.end())
+    {
+        mPending.erase(it);
+        mWindow.notify_all();
+    }
+    request->done = true;
+    lost(request);
+}
+
+void serial_controller::lost(const request_ptr &request)
+{
+    ROBOTEQ_TRACE(lost, request->mnemonic, reinterpret_cast<uintptr_t>(request.get()));
+    mLatency.timeout(request->mnemonic);
+    if(mLink.failure())
+    {
+        ROS_ERROR_STREAM("Serial port " << mSerialPort << " link degraded, fast fail of all transactions");
+    }
+}
+
+bool serial_controller::wait(const request_ptr &request)
+{
+    std::unique_lock<std::mutex> lck(mReaderMutex);
+    while(!request->done)
+    {
+        // The deadline move forward while the replies before are received
+        if(request->cv.wait_until(lck, request->deadline) == std::cv_status::timeout
+                && std::chrono::steady_clock::now() >= request->deadline)
+        {
+            expire(request);
+        }
+    }
+    ROBOTEQ_TRACE(wakeup, request->mnemonic, reinterpret_cast<uintptr_t>(request.get()));
+    return request->received && request->status;
+}
+
+bool serial_controller::poll(const request_ptr &request)
+{
+    std::lock_guard<std::mutex> lck(mReaderMutex);
+    if(request->done)
+        return true;
+    if(std::chrono::steady_clock::now() < request->deadline)
+        return false;
+    expire(request);
+    return true;
+}
+
+request_ptr serial_controller::asyncCommand(string msg, string params, string type, priority_t priority)
+{
+    //mwh update - add ! as type for action command
+    if (type.compare("") == 0) type = "!";
+    return send(msg, params, type, false, priority);
+}
+
+request_ptr serial_controller::asyncQuery(string msg, string params, string type, priority_t priority)
+{
+    return send(msg, params, type, true, priority);
+}
+
+request_ptr serial_controller::transaction(string msg, string params, string type, bool query, priority_t priority)
+{
+    if(priority == PRIORITY_AUTO) priority = classify(msg, type);
+    unsigned int budget = mRetryBudget[priority];
+    {
+        // A link degraded has only one attempt, the emergency stop keep all attempts
+        std::lock_guard<std::mutex> lck(mReaderMutex);
+        if(mLink.degraded() && priority != PRIORITY_ESTOP)
+            budget = 1;
+    }
+    request_ptr request;
     unsigned int counter = 0;
-    while (counter < 5)
+    while (counter < budget)
     {
-        mSerial.write(msg2.c_str());
-        data = false;
-        // Set lock variable and wait a data to return
-        std::unique_lock<std::mutex> lck(mReaderMutex);
-        // TODO change timeout
-        cv.wait_for(lck, std::chrono::seconds(1));
-        if(data)
+        request = send(msg, params, type, query, priority, counter);
+        wait(request);
+        // Check if the reply is arrived
+        if(request->received)
         {
-            ROS_DEBUG_STREAM("N:" << (counter+1) << " CMD:" << msg << " DATA:" << sub_data_cmd);
+            ROS_DEBUG_STREAM("N:" << (counter+1) << " CMD:" << msg << " DATA:" << (query ? request->data : (request->status ? "+" : "-")));
             break;
-        } else
+        }
+        // Increase counter
+        counter++;
+        if(counter < budget)
         {
-            // Increase counter
-            counter++;
+            std::lock_guard<std::mutex> lck(mReaderMutex);
+            mLink.retry();
+            mLatency.retry(request->mnemonic);
         }
     }
-    // Unlock mutex
-    mWriteMutex.unlock();
-    return sub_data_cmd;
+    return request;
 }
 
-bool serial_controller::query(string msg, string params, string type) {
-    mWriteMutex.lock();
-    mMessage = msg;
-    string msg2;
-    if(params.compare("") == 0) {
-        msg2 = type + msg + eol;
-    } else {
-        msg2 = type + msg + " " + params + eol;
+bool serial_controller::command(string msg, string params, string type, priority_t priority)
+{
+    //mwh update - add ! as type for action command
+    if (type.compare("") == 0) type = "!";
+    return transaction(msg, params, type, false, priority)->status;
+}
+
+bool serial_controller::query(string msg, string params, string type, priority_t priority) {
+    request_ptr request = transaction(msg, params, type, true, priority);
+    if(request->status)
+    {
+        sub_data = request->data;
     }
+    return request->status;
+}
 
-    unsigned int counter = 0;
-    while (counter < 5)
+bool serial_controller::complete(const boost::string_ref &name, bool status, const boost::string_ref &data)
+{
+    std::lock_guard<std::mutex> lck(mReaderMutex);
+    // A bare '-' is the reply of the oldest request: a command, or a query refused by the board.
+    // A bare '+' is only the reply of a command, the queries before it lost their reply.
+    // Only NAME=value replies match the name
+    deque<request_ptr>::iterator it = mPending.begin();
+    if(!name.empty() || status)
     {
-        ROS_DEBUG_STREAM("N:" << (counter+1) << " TX: " << msg);
-        mSerial.write(msg2.c_str());
-        data = false;
-        // Set lock variable and wait a data to return
-        std::unique_lock<std::mutex> lck(mReaderMutex);
-        cv.wait_for(lck, std::chrono::seconds(1));
-        if(data)
+        // Find the first request waiting this reply, the commands have an empty name
+        for(; it != mPending.end(); ++it)
         {
-            ROS_DEBUG_STREAM("N:" << (counter+1) << " CMD:" << msg << " DATA:" << sub_data);
+            if(boost::string_ref((*it)->name) == name)
+                break;
+        }
+    }
+    // Not requested message
+    if(it == mPending.end())
+        return false;
+    // The requests before lost the reply
+    for(deque<request_ptr>::iterator lost = mPending.begin(); lost != it; ++lost)
+    {
+        ROS_DEBUG_STREAM("Lost reply: " << (*lost)->name);
+        (*lost)->done = true;
+        (*lost)->cv.notify_all();
+        this->lost(*lost);
+    }
+    // Close the request
+    request_ptr request = *it;
+    // Karn's rule: the reply of a retried request can be the late reply of the attempt before,
+    // only the replies of a first transmission are sampled
+    if(request->attempt == 0)
+    {
+        std::chrono::steady_clock::duration rtt = std::chrono::steady_clock::now() - request->sent;
+        mLink.sample(rtt);
+        mLatency.record(request->mnemonic, std::chrono::duration_cast<std::chrono::microseconds>(rtt).count());
+    }
+    ROBOTEQ_TRACE(complete, request->mnemonic, reinterpret_cast<uintptr_t>(request.get()));
+    if(mLink.success())
+    {
+        ROS_INFO_STREAM("Serial port " << mSerialPort << " link recovered");
+    }
+    request->data.assign(data.data(), data.size());
+    request->status = status;
+    request->received = true;
+    request->done = true;
+    request->cv.notify_all();
+    // Free the reply queue
+    mPending.erase(mPending.begin(), it + 1);
+    mWindow.notify_all();
+    // The link is alive, restart the timer of the requests in flight as TCP (RFC 6298, 5.3).
+    // The replies of a batch arrive one after the other at the speed of the line
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + mLink.timeout(0);
+    for(deque<request_ptr>::iterator next = mPending.begin(); next != mPending.end(); ++next)
+    {
+        (*next)->deadline = std::max((*next)->deadline, deadline);
+    }
+    return true;
+}
+
+void serial_controller::dispatch(const boost::string_ref &line)
+{
+    boost::string_ref sub_cmd, data;
+    ROS_DEBUG_STREAM_NAMED("serial", "RX: " << line);
+    switch(scan_line(line, sub_cmd, data))
+    {
+    case LINE_ACK:
+    case LINE_NACK:
+        // Unlock the oldest command, a query refused from the board reply '-' as a command
+        complete(boost::string_ref(), (line[0] == '+'), boost::string_ref());
+        break;
+    case LINE_QUERY:
+        // ROS_INFO_STREAM("CMD=" << sub_cmd << " DATA=" << data);
+        // Check first of all a message sent require a data to return.
+        // The stream has priority, the board repeat the history buffer in order
+        if(!streamNext(sub_cmd) && complete(sub_cmd, true, data))
+        {
+            // Skip other request
             break;
-        } else
+        }
+        // Find in all callback a data to send
+        for(map<string, callback_data_t>::iterator it = hashmap.begin(); it != hashmap.end(); ++it)
         {
-            // Increase counter
-            counter++;
+            if(boost::string_ref(it->first) == sub_cmd)
+            {
+                // Launch callback with return query
+                ROBOTEQ_TRACE(dispatch, mnemonic_key(sub_cmd), 0);
+                it->second(data);
+                break;
+            }
         }
+        break;
+    case LINE_HLD:
+        isHLD = true;
+        // Unlock query request
+        cv.notify_one();
+        break;
+    case LINE_EMPTY:
+        break;
+    default:
+        ROS_INFO_STREAM("Other message " << line);
+        break;
     }
-    // Clear last query request
-    mMessage = "";
-    // Unlock mutex
-    mWriteMutex.unlock();
-    return data;
+}
+
+bool serial_controller::reconnect()
+{
+    // Close between two lines sent
+    mScheduler.acquire(PRIORITY_ESTOP, 0);
+    mSerial->close();
+    mScheduler.release();
+    mRx.clear();
+    while(!mStopping)
+    {
+        for(int i = 0; i < reconnect_period && !mStopping; i += 50)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if(mStopping)
+            break;
+        mScheduler.acquire(PRIORITY_ESTOP, 0);
+        bool opened = mSerial->open();
+        mScheduler.release();
+        if(opened)
+        {
+            {
+                std::lock_guard<std::mutex> lck(mReaderMutex);
+                mLink.reconnect();
+            }
+            ROS_WARN_STREAM("Serial port " << mSerialPort << " open again");
+            return true;
+        }
+    }
+    return false;
 }
 
 void serial_controller::async_reader()
 {
+    boost::string_ref line;
     while (!mStopping) {
-        // Read how many byte waiting to read
-        ROS_DEBUG_STREAM_NAMED("serial", "Bytes waiting: " << mSerial.available());
-        // Read line
-        std::string msg = mSerial.readline(max_line_length, eol);
-        // Decode message
-        if (!msg.empty())
+        // Wait new bytes and read them in the ring buffer, wake up on stop
+        size_t size;
+        char* buffer = mRx.prepare(size);
+        long received = mSerial->read(buffer, size, mTimeout);
+        if(received < 0)
+        {
+            if(mStopping)
+                break;
+            ROS_ERROR_STREAM("Serial port " << mSerialPort << " - Error: " << mSerial->error());
+            // A USB adapter come back after a disconnect, the requests in flight expire
+            if(!reconnect())
+                break;
+            continue;
+        }
+        if(received > 0)
+        {
+            // All lines before are decoded, these bytes start a new line
+            if(mRx.empty())
+                ROBOTEQ_TRACE(rx_first, received, 0);
+            mCapture.record(CAPTURE_RX, buffer, received);
+        }
+        mRx.commit(received);
+        // Decode all lines complete
+        while(mRx.next(line))
         {
-          ROS_DEBUG_STREAM_NAMED("serial", "RX: " << msg);
-          if (std::regex_match(msg, rgx_cmd))
-          {
-              // Decode if command return true
-              if(msg[0] == '+') sub_data_cmd = true;
-              else sub_data_cmd = false;
-              // Unlock command
-              data = true;
-              // Unlock query request
-              cv.notify_all();
-          }
-          else if(std::regex_match(msg, rgx_query))
-          {
-              // Get command
-              string sub_cmd = msg.substr(0, msg.find('='));
-              // Evaluate end position string
-              long end_string = (msg.size()-1) - (msg.find('=') + 1);
-              // Get data
-              sub_data = msg.substr(msg.find('=') + 1, end_string);
-              // ROS_INFO_STREAM("CMD=" << sub_cmd << " DATA=" << sub_data);
-              // Check first of all a message sent require a data to return
-              if(mMessage.compare("") != 0) {
-                  if(mMessage.compare(sub_cmd) == 0) {
-                      data = true;
-                      // Unlock query request
-                      cv.notify_all();
-                      // Skip other request
-                      continue;
-                  }
-              }
-              // Find in all callback a data to send
-              if (hashmap.find(sub_cmd) != hashmap.end())
-              {
-                  // Get callback from hashmap
-                  callback_data_t callback = hashmap[sub_cmd];
-                  // Launch callback with return query
-                  callback(sub_data);
-              }
-          }
-          else if(msg.compare("HLD\r") == 0)
-          {
-              isHLD = true;
-              // Unlock query request
-              cv.notify_one();
-          }
-          else
-          {
-              ROS_INFO_STREAM("Other message " << msg);
-          }
+            ROBOTEQ_TRACE(line, line.size(), 0);
+            dispatch(line);
         }
     }
     ROS_INFO("Async serial reader closed");
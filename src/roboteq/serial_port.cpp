@@ -0,0 +1,112 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/serial_port.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+namespace roboteq {
+
+/**
+ * @brief baudrate_flag Convert the baudrate in the termios speed
+ * @param baudrate The baudrate
+ * @return The termios speed, B0 if not supported
+ */
+static speed_t baudrate_flag(unsigned long baudrate)
+{
+    switch(baudrate)
+    {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B0;
+    }
+}
+
+serial_port::serial_port(const std::string &port, unsigned long baudrate)
+    : mPort(port)
+    , mBaudrate(baudrate)
+{
+}
+
+bool serial_port::open()
+{
+    if(isOpen())
+        return true;
+    int fd = ::open(mPort.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0)
+        return fail("open " + mPort);
+    // From now the descriptor is closed with the transport
+    mFd = fd;
+    // Raw mode, 8N1 without flow control
+    struct termios tty;
+    if(tcgetattr(fd, &tty) < 0)
+        return fail("tcgetattr");
+    cfmakeraw(&tty);
+    tty.c_cflag |= (CLOCAL | CREAD);
+    tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+    // The wait is in epoll. With O_NONBLOCK and VMIN 1 an empty buffer return EAGAIN,
+    // with VMIN 0 the read return 0 as on a closed connection
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    speed_t speed = baudrate_flag(mBaudrate);
+    if(speed == B0)
+    {
+        errno = EINVAL;
+        return fail("baudrate " + std::to_string(mBaudrate));
+    }
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    if(tcsetattr(fd, TCSANOW, &tty) < 0)
+        return fail("tcsetattr");
+    tcflush(fd, TCIOFLUSH);
+    // Skip the latency timer of the USB adapters, not supported from all drivers
+    struct serial_struct serial;
+    if(ioctl(fd, TIOCGSERIAL, &serial) == 0)
+    {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &serial);
+    }
+    return attach(fd);
+}
+
+}
@@ -0,0 +1,282 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/session_capture.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace roboteq {
+
+const char capture_magic[8] = "RQCAP01";
+// Period of the background writer in ms
+const int writer_period(10);
+
+session_capture::session_capture()
+    : mEnabled(false)
+    , mActive(0)
+    , mDropped(0)
+    , mHeader(NULL)
+    , mRing(NULL)
+    , mRunning(false)
+{
+    mStageUsed[0] = mStageUsed[1] = 0;
+}
+
+session_capture::~session_capture()
+{
+    stop();
+}
+
+bool session_capture::start(const std::string &path, size_t size)
+{
+    stop();
+    size_t capacity = size & ~static_cast<size_t>(7);
+    if(capacity < 4096)
+    {
+        mError = "capture size too small";
+        return false;
+    }
+    if(!mFile.create(path, sizeof(capture_header_t) + capacity))
+    {
+        mError = mFile.error();
+        return false;
+    }
+    mHeader = reinterpret_cast<capture_header_t*>(mFile.data());
+    mRing = mFile.data() + sizeof(capture_header_t);
+    memset(mHeader, 0, sizeof(capture_header_t));
+    mHeader->capacity = capacity;
+    memcpy(mHeader->magic, capture_magic, sizeof(capture_magic));
+    mStageUsed[0] = mStageUsed[1] = 0;
+    mDropped = 0;
+    mRunning = true;
+    mWriter = std::thread(&session_capture::run, this);
+    mEnabled = true;
+    return true;
+}
+
+void session_capture::stop()
+{
+    if(!mRunning)
+        return;
+    mEnabled = false;
+    mRunning = false;
+    if(mWriter.joinable())
+        mWriter.join();
+    // The last records from the serial threads
+    flush();
+    mFile.sync();
+    mFile.close();
+    mHeader = NULL;
+    mRing = NULL;
+}
+
+void session_capture::push(capture_direction_t direction, const char* data, size_t size)
+{
+    uint64_t stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    size_t total = capture_record_size(size);
+    std::lock_guard<std::mutex> lck(mStageMutex);
+    size_t &used = mStageUsed[mActive];
+    if(used + total > stage_size)
+    {
+        // The writer is late, the chunk is lost
+        mDropped++;
+        return;
+    }
+    capture_record_t* record = reinterpret_cast<capture_record_t*>(mStage[mActive] + used);
+    record->length = size;
+    record->direction = direction;
+    record->reserved = 0;
+    record->stamp = stamp;
+    memcpy(record + 1, data, size);
+    used += total;
+}
+
+void session_capture::run()
+{
+    while(mRunning)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(writer_period));
+        flush();
+    }
+}
+
+void session_capture::flush()
+{
+    int ready;
+    size_t used;
+    uint64_t dropped;
+    {
+        // Swap the staging buffers, the serial threads continue on the other one
+        std::lock_guard<std::mutex> lck(mStageMutex);
+        ready = mActive;
+        used = mStageUsed[ready];
+        dropped = mDropped;
+        mActive = 1 - mActive;
+        mStageUsed[mActive] = 0;
+    }
+    for(size_t offset = 0; offset < used;)
+    {
+        const capture_record_t* record = reinterpret_cast<const capture_record_t*>(mStage[ready] + offset);
+        append(record);
+        offset += capture_record_size(record->length);
+    }
+    mHeader->dropped = dropped;
+}
+
+void session_capture::reclaim(uint64_t end)
+{
+    uint64_t capacity = mHeader->capacity;
+    uint64_t tail = mHeader->tail;
+    while(end - tail > capacity)
+    {
+        uint64_t pos = tail % capacity;
+        if(capacity - pos < sizeof(capture_record_t))
+        {
+            // Too small for a record, the reader skip to the start
+            tail += capacity - pos;
+            continue;
+        }
+        const capture_record_t* old = reinterpret_cast<const capture_record_t*>(mRing + pos);
+        tail += capture_record_size(old->length);
+    }
+    // The tail move before the records are overwritten
+    __atomic_store_n(&mHeader->tail, tail, __ATOMIC_RELEASE);
+}
+
+void session_capture::append(const capture_record_t* record)
+{
+    uint64_t capacity = mHeader->capacity;
+    size_t size = capture_record_size(record->length);
+    if(size > capacity / 2)
+        return;
+    uint64_t head = mHeader->head;
+    uint64_t pos = head % capacity;
+    if(capacity - pos < size)
+    {
+        // Fill to the end of the ring and restart from the begin
+        uint64_t pad = capacity - pos;
+        reclaim(head + pad);
+        if(pad >= sizeof(capture_record_t))
+        {
+            capture_record_t* filler = reinterpret_cast<capture_record_t*>(mRing + pos);
+            filler->length = pad - sizeof(capture_record_t);
+            filler->direction = CAPTURE_PAD;
+            filler->reserved = 0;
+            filler->stamp = record->stamp;
+        }
+        head += pad;
+        pos = 0;
+    }
+    reclaim(head + size);
+    memcpy(mRing + pos, record, sizeof(capture_record_t) + record->length);
+    mHeader->records++;
+    // The record is complete before the head move
+    __atomic_store_n(&mHeader->head, head + size, __ATOMIC_RELEASE);
+}
+
+capture_reader::capture_reader()
+    : mRing(NULL)
+    , mOffset(0)
+{
+    memset(&mHeaderCopy, 0, sizeof(mHeaderCopy));
+}
+
+capture_reader::~capture_reader()
+{
+    close();
+}
+
+bool capture_reader::open(const std::string &path)
+{
+    close();
+    if(!mFile.open(path))
+    {
+        mError = mFile.error();
+        return false;
+    }
+    if(mFile.size() < sizeof(capture_header_t))
+    {
+        mError = path + ": not a capture file";
+        close();
+        return false;
+    }
+    // Snapshot of the header, the file can be still written
+    memcpy(&mHeaderCopy, mFile.data(), sizeof(capture_header_t));
+    if(memcmp(mHeaderCopy.magic, capture_magic, sizeof(capture_magic)) != 0
+            || mHeaderCopy.capacity == 0
+            || sizeof(capture_header_t) + mHeaderCopy.capacity > mFile.size())
+    {
+        mError = path + ": not a capture file";
+        close();
+        return false;
+    }
+    mRing = mFile.data() + sizeof(capture_header_t);
+    rewind();
+    return true;
+}
+
+void capture_reader::close()
+{
+    mFile.close();
+    mRing = NULL;
+}
+
+void capture_reader::rewind()
+{
+    mOffset = mHeaderCopy.tail;
+}
+
+bool capture_reader::next(capture_record_t &record, boost::string_ref &payload)
+{
+    uint64_t capacity = mHeaderCopy.capacity;
+    while(mRing != NULL && mOffset < mHeaderCopy.head)
+    {
+        uint64_t pos = mOffset % capacity;
+        if(capacity - pos < sizeof(capture_record_t))
+        {
+            mOffset += capacity - pos;
+            continue;
+        }
+        memcpy(&record, mRing + pos, sizeof(capture_record_t));
+        size_t size = capture_record_size(record.length);
+        if(size > capacity - pos)
+            return false;
+        mOffset += size;
+        if(record.direction == CAPTURE_PAD)
+            continue;
+        payload = boost::string_ref(mRing + pos + sizeof(capture_record_t), record.length);
+        return true;
+    }
+    return false;
+}
+
+}
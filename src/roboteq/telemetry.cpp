@@ -0,0 +1,99 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/telemetry.h"
+
+namespace roboteq {
+
+const char* const telemetry_query[TELEMETRY_FIELDS][2] = {
+    {"FM", ""},     // motor status flags [pag. 246]
+    {"M", ""},      // motor command [pag. 250]
+    {"F", ""},      // motor feedback [pag. 244]
+    {"E", ""},      // motor loop error [pag. 244]
+    {"P", ""},      // motor power [pag. 255]
+    {"V", "2"},     // power supply voltage [pag. 262]
+    {"A", ""},      // motor Amps [pag. 230]
+    {"BA", ""},     // motor battery amps [pag. 233]
+    {"C", ""},      // position encoder value [pag. 236]
+    {"TR", ""}      // motor track [pag. 260]
+};
+
+decode_status_t decode_field(telemetry_field_t field, const boost::string_ref &data, motor_frame_t *frames, size_t channels)
+{
+    const char* p = data.data();
+    const char* end = p + data.size();
+    int32_t value;
+    decode_status_t status;
+    // The power supply voltage is the same for all channels
+    if(field == FIELD_VOLTS)
+    {
+        status = parse_int(p, end, value);
+        if(status != DECODE_OK)
+            return status;
+        for(size_t i = 0; i < channels; ++i)
+        {
+            frames[i].value[field] = value;
+            frames[i].valid |= (1 << field);
+        }
+        return DECODE_OK;
+    }
+    size_t channel = 0;
+    while(true)
+    {
+        status = parse_int(p, end, value);
+        if(status != DECODE_OK)
+            return status;
+        // The board can have more channels than motors
+        if(channel < channels)
+        {
+            frames[channel].value[field] = value;
+            frames[channel].valid |= (1 << field);
+        }
+        channel++;
+        if(p == end)
+            break;
+        if(*p != ':')
+            return DECODE_INVALID;
+        ++p;
+    }
+    return (channel < channels) ? DECODE_MISSING : DECODE_OK;
+}
+
+decode_status_t decode_value(const boost::string_ref &data, int32_t &value)
+{
+    const char* p = data.data();
+    const char* end = p + data.size();
+    decode_status_t status = parse_int(p, end, value);
+    if(status != DECODE_OK)
+        return status;
+    return (p == end) ? DECODE_OK : DECODE_INVALID;
+}
+
+}
@@ -0,0 +1,452 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/telemetry_archive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace roboteq {
+
+const char archive_magic[8] = "RQARC01";
+const char chunk_magic[4] = {'R', 'Q', 'C', 'H'};
+// Period of the background writer in ms
+const int archive_period(100);
+
+/**
+ * @brief put_varint Append an unsigned integer in 7 bits groups, the high bit set if more follow
+ */
+static void put_varint(std::vector<char> &out, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**
+ * @brief put_signed Append a signed integer, zig-zag mapped to keep small the negative numbers
+ */
+static void put_signed(std::vector<char> &out, int64_t value)
+{
+    put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+static bool get_varint(const uint8_t* &p, const uint8_t* end, uint64_t &value)
+{
+    value = 0;
+    for(int shift = 0; p != end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool get_signed(const uint8_t* &p, const uint8_t* end, int64_t &value)
+{
+    uint64_t zigzag;
+    if(!get_varint(p, end, zigzag))
+        return false;
+    value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+    return true;
+}
+
+/**
+ * @brief encode_delta The first value and the differences with the previous
+ */
+template <class T>
+static void encode_delta(std::vector<char> &out, const T *values, size_t rows)
+{
+    int64_t previous = 0;
+    for(size_t i = 0; i < rows; ++i)
+    {
+        put_signed(out, static_cast<int64_t>(values[i]) - previous);
+        previous = values[i];
+    }
+}
+
+/**
+ * @brief encode_rle The runs of the same value
+ */
+template <class T>
+static void encode_rle(std::vector<char> &out, const T *values, size_t rows)
+{
+    for(size_t i = 0; i < rows;)
+    {
+        size_t run = 1;
+        while(i + run < rows && values[i + run] == values[i])
+            ++run;
+        put_signed(out, static_cast<int64_t>(values[i]));
+        put_varint(out, run);
+        i += run;
+    }
+}
+
+archive_writer::archive_writer()
+    : mEnabled(false)
+    , mFd(-1)
+    , mWallOffset(0)
+    , mDropped(0)
+    , mRunning(false)
+{
+}
+
+archive_writer::~archive_writer()
+{
+    stop();
+}
+
+bool archive_writer::start(const std::string &path)
+{
+    stop();
+    mFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(mFd < 0)
+    {
+        mError = path + ": " + strerror(errno);
+        return false;
+    }
+    // A new archive start with the header, the chunks of the next runs follow
+    if(lseek(mFd, 0, SEEK_END) == 0)
+    {
+        archive_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, archive_magic, sizeof(archive_magic));
+        header.fields = TELEMETRY_FIELDS;
+        if(::write(mFd, &header, sizeof(header)) != sizeof(header))
+        {
+            mError = path + ": " + strerror(errno);
+            ::close(mFd);
+            mFd = -1;
+            return false;
+        }
+    }
+    mWallOffset = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count()
+            - std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    mBlocks.reset(new archive_block_t[2 * max_channels]);
+    for(size_t i = 0; i < 2 * max_channels; ++i)
+    {
+        // Touch all pages now, not in the control loop
+        memset(mBlocks[i].time, 0, sizeof(mBlocks[i].time));
+        memset(mBlocks[i].valid, 0, sizeof(mBlocks[i].valid));
+        memset(mBlocks[i].value, 0, sizeof(mBlocks[i].value));
+        mBlocks[i].rows = 0;
+        mBlocks[i].ready = false;
+    }
+    for(size_t i = 0; i < max_channels; ++i)
+    {
+        mActive[i] = 0;
+        mLast[i] = 0;
+    }
+    mChunk.reserve(sizeof(archive_chunk_t) + archive_rows * ARCHIVE_COLUMNS * 4);
+    mDropped = 0;
+    mRunning = true;
+    mWriter = std::thread(&archive_writer::run, this);
+    mEnabled = true;
+    return true;
+}
+
+void archive_writer::stop()
+{
+    if(!mRunning)
+        return;
+    mEnabled = false;
+    {
+        std::lock_guard<std::mutex> lck(mMutex);
+        mRunning = false;
+    }
+    mWake.notify_one();
+    if(mWriter.joinable())
+        mWriter.join();
+    // The rows of the blocks not full
+    flush(true);
+    ::close(mFd);
+    mFd = -1;
+}
+
+void archive_writer::push(size_t channel, const motor_frame_t &frame)
+{
+    // The control loop can see the same frame more times
+    uint64_t stamp = 0;
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+    {
+        if(frame.valid & (1 << n))
+            stamp = std::max(stamp, frame.stamp[n]);
+    }
+    if(stamp == 0 || stamp == mLast[channel])
+        return;
+    mLast[channel] = stamp;
+    archive_block_t &block = mBlocks[2 * channel + mActive[channel]];
+    size_t row = block.rows;
+    block.time[row] = (static_cast<int64_t>(stamp) + mWallOffset) / 1000;
+    block.valid[row] = frame.valid;
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+    {
+        // A field not decoded repeat the previous value, it costs only one byte
+        if(frame.valid & (1 << n))
+            block.value[n][row] = frame.value[n];
+        else
+            block.value[n][row] = (row > 0) ? block.value[n][row - 1] : 0;
+    }
+    block.rows = row + 1;
+    if(block.rows < archive_rows)
+        return;
+    archive_block_t &next = mBlocks[2 * channel + 1 - mActive[channel]];
+    if(next.ready.load(std::memory_order_acquire))
+    {
+        // The writer is late, the rows of this block are lost
+        mDropped.fetch_add(block.rows, std::memory_order_relaxed);
+        block.rows = 0;
+        return;
+    }
+    // The writer take it at the next period, a block last seconds
+    block.ready.store(true, std::memory_order_release);
+    mActive[channel] = 1 - mActive[channel];
+}
+
+void archive_writer::sync()
+{
+    for(size_t i = 0; mBlocks && i < 2 * max_channels; ++i)
+    {
+        while(mRunning && mBlocks[i].ready.load(std::memory_order_acquire))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void archive_writer::run()
+{
+    std::unique_lock<std::mutex> lck(mMutex);
+    while(mRunning)
+    {
+        mWake.wait_for(lck, std::chrono::milliseconds(archive_period));
+        lck.unlock();
+        flush(false);
+        lck.lock();
+    }
+}
+
+void archive_writer::flush(bool partial)
+{
+    for(size_t channel = 0; channel < max_channels; ++channel)
+    {
+        // The oldest block first
+        for(int i = 1; i <= 2; ++i)
+        {
+            archive_block_t &block = mBlocks[2 * channel + (mActive[channel] + i) % 2];
+            if(block.ready.load(std::memory_order_acquire))
+            {
+                write(channel, block);
+                block.rows = 0;
+                block.ready.store(false, std::memory_order_release);
+            }
+            else if(partial && block.rows > 0)
+            {
+                write(channel, block);
+                block.rows = 0;
+            }
+        }
+    }
+}
+
+void archive_writer::write(size_t channel, const archive_block_t &block)
+{
+    mChunk.assign(sizeof(archive_chunk_t), 0);
+    archive_chunk_t chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    memcpy(chunk.magic, chunk_magic, sizeof(chunk_magic));
+    chunk.rows = block.rows;
+    chunk.channel = channel;
+    chunk.columns = ARCHIVE_COLUMNS;
+    chunk.first = block.time[0];
+    chunk.last = block.time[block.rows - 1];
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+    {
+        chunk.min[n] = INT32_MAX;
+        chunk.max[n] = INT32_MIN;
+        for(size_t row = 0; row < block.rows; ++row)
+        {
+            if(block.valid[row] & (1 << n))
+            {
+                chunk.min[n] = std::min(chunk.min[n], block.value[n][row]);
+                chunk.max[n] = std::max(chunk.max[n], block.value[n][row]);
+            }
+        }
+    }
+    for(size_t c = 0; c < ARCHIVE_COLUMNS; ++c)
+    {
+        chunk.column[c].offset = mChunk.size();
+        if(c == COLUMN_TIME)
+        {
+            chunk.column[c].encoding = ENCODING_DELTA;
+            encode_delta(mChunk, block.time, block.rows);
+        }
+        else if(c == COLUMN_VALID)
+        {
+            chunk.column[c].encoding = ENCODING_RLE;
+            encode_rle(mChunk, block.valid, block.rows);
+        }
+        else if(c - COLUMN_FIELDS == FIELD_FLAGS)
+        {
+            // The flags change rarely
+            chunk.column[c].encoding = ENCODING_RLE;
+            encode_rle(mChunk, block.value[c - COLUMN_FIELDS], block.rows);
+        }
+        else
+        {
+            // Counters, currents and the other values move slowly between two rows
+            chunk.column[c].encoding = ENCODING_DELTA;
+            encode_delta(mChunk, block.value[c - COLUMN_FIELDS], block.rows);
+        }
+        chunk.column[c].size = mChunk.size() - chunk.column[c].offset;
+    }
+    // The next chunk aligned to 8 bytes, the header can be read in place
+    mChunk.resize((mChunk.size() + 7) & ~static_cast<size_t>(7), 0);
+    chunk.size = mChunk.size();
+    memcpy(mChunk.data(), &chunk, sizeof(chunk));
+    if(::write(mFd, mChunk.data(), mChunk.size()) != static_cast<ssize_t>(mChunk.size()))
+    {
+        mError = strerror(errno);
+        mDropped.fetch_add(block.rows, std::memory_order_relaxed);
+    }
+}
+
+archive_reader::archive_reader()
+    : mOffset(0)
+{
+}
+
+bool archive_reader::open(const std::string &path)
+{
+    close();
+    if(!mFile.open(path))
+    {
+        mError = mFile.error();
+        return false;
+    }
+    const archive_header_t* header = reinterpret_cast<const archive_header_t*>(mFile.data());
+    if(mFile.size() < sizeof(archive_header_t)
+            || memcmp(header->magic, archive_magic, sizeof(archive_magic)) != 0
+            || header->fields != TELEMETRY_FIELDS)
+    {
+        mError = path + ": not an archive";
+        close();
+        return false;
+    }
+    rewind();
+    return true;
+}
+
+void archive_reader::close()
+{
+    mFile.close();
+    mOffset = 0;
+}
+
+void archive_reader::rewind()
+{
+    mOffset = sizeof(archive_header_t);
+}
+
+const archive_chunk_t* archive_reader::next()
+{
+    if(!mFile.isOpen() || mOffset + sizeof(archive_chunk_t) > mFile.size())
+        return NULL;
+    const archive_chunk_t* chunk = reinterpret_cast<const archive_chunk_t*>(mFile.data() + mOffset);
+    if(memcmp(chunk->magic, chunk_magic, sizeof(chunk_magic)) != 0
+            || chunk->size < sizeof(archive_chunk_t)
+            || mOffset + chunk->size > mFile.size()
+            || chunk->columns != ARCHIVE_COLUMNS)
+        return NULL;
+    mOffset += chunk->size;
+    return chunk;
+}
+
+bool archive_reader::decode(const archive_chunk_t *chunk, archive_column_id_t column, std::vector<int64_t> &values) const
+{
+    const archive_column_t &info = chunk->column[column];
+    if(static_cast<size_t>(info.offset) + info.size > chunk->size)
+        return false;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(chunk) + info.offset;
+    const uint8_t* end = p + info.size;
+    values.clear();
+    if(info.encoding == ENCODING_DELTA)
+    {
+        int64_t value = 0, delta;
+        while(values.size() < chunk->rows && get_signed(p, end, delta))
+        {
+            value += delta;
+            values.push_back(value);
+        }
+    }
+    else
+    {
+        std::vector<archive_run_t> items;
+        if(!runs(chunk, column, items))
+            return false;
+        for(size_t i = 0; i < items.size(); ++i)
+            values.insert(values.end(), items[i].length, items[i].value);
+    }
+    return values.size() == chunk->rows;
+}
+
+bool archive_reader::runs(const archive_chunk_t *chunk, archive_column_id_t column, std::vector<archive_run_t> &runs) const
+{
+    const archive_column_t &info = chunk->column[column];
+    if(info.encoding != ENCODING_RLE || static_cast<size_t>(info.offset) + info.size > chunk->size)
+        return false;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(chunk) + info.offset;
+    const uint8_t* end = p + info.size;
+    runs.clear();
+    size_t rows = 0;
+    while(rows < chunk->rows)
+    {
+        archive_run_t run;
+        uint64_t length;
+        if(!get_signed(p, end, run.value) || !get_varint(p, end, length) || length == 0 || rows + length > chunk->rows)
+            return false;
+        run.length = length;
+        rows += length;
+        runs.push_back(run);
+    }
+    return true;
+}
+
+}
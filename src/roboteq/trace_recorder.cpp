@@ -0,0 +1,215 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/trace_recorder.h"
+#include "roboteq/latency_histogram.h"
+#include "roboteq/phase_profiler.h"
+
+#include <stdio.h>
+#include <thread>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace roboteq {
+
+std::atomic<bool> trace_recorder::_enabled(false);
+
+/**
+ * @brief thread_id The kernel id of the calling thread, the same shown from top and perf
+ * @return The thread id
+ */
+static uint32_t thread_id()
+{
+    static thread_local uint32_t tid = syscall(SYS_gettid);
+    return tid;
+}
+
+/**
+ * @brief mnemonic_name Unpack a mnemonic packed with mnemonic_key
+ * @param key The key
+ * @return The mnemonic
+ */
+static std::string mnemonic_name(uint64_t key)
+{
+    std::string name;
+    for(; key != 0; key >>= 8)
+        name += static_cast<char>(key & 0xFF);
+    return name.empty() ? "+" : name;
+}
+
+trace_recorder& trace_recorder::instance()
+{
+    static trace_recorder recorder;
+    return recorder;
+}
+
+trace_recorder::trace_recorder()
+    : _mask(0)
+    , _head(0)
+    , _writers(0)
+{
+}
+
+void trace_recorder::start(size_t capacity)
+{
+    stop();
+    size_t size = 1;
+    while(size < capacity)
+        size <<= 1;
+    // The ring is never freed while the recorder is started
+    if(!_ring || _mask + 1 != size)
+    {
+        _ring.reset(new trace_slot_t[size]);
+        _mask = size - 1;
+    }
+    for(size_t i = 0; i < size; ++i)
+    {
+        _ring[i].sequence.store(0, std::memory_order_relaxed);
+    }
+    _head.store(0, std::memory_order_relaxed);
+    _enabled.store(true, std::memory_order_release);
+}
+
+void trace_recorder::stop()
+{
+    // A writer sees the recorder stopped or is counted before the check, both sequentially consistent
+    _enabled.store(false);
+    while(_writers.load() != 0)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void trace_recorder::record(trace_event_t event, uint64_t arg, uint64_t id)
+{
+    // Check again inside the writers, the recorder can be stopped after the check of the caller
+    _writers.fetch_add(1);
+    if(!_enabled.load())
+    {
+        _writers.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    uint64_t index = _head.fetch_add(1, std::memory_order_relaxed);
+    trace_slot_t &slot = _ring[index & _mask];
+    // Zero sequence, write in progress
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record.stamp = monotonic_ns();
+    slot.record.arg = arg;
+    slot.record.id = id;
+    slot.record.tid = thread_id();
+    slot.record.event = event;
+    slot.sequence.store(index + 1, std::memory_order_release);
+    _writers.fetch_sub(1, std::memory_order_release);
+}
+
+long trace_recorder::save(const std::string &path) const
+{
+    if(!_ring)
+        return -1;
+    FILE *file = fopen(path.c_str(), "w");
+    if(file == NULL)
+        return -1;
+    uint64_t head = _head.load(std::memory_order_acquire);
+    uint64_t first = (head > _mask + 1) ? head - (_mask + 1) : 0;
+    long saved = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for(uint64_t index = first; index < head; ++index)
+    {
+        const trace_slot_t &slot = _ring[index & _mask];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        trace_record_t record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // Skip the events in progress or overwritten
+        if(before != index + 1 || slot.sequence.load(std::memory_order_relaxed) != before)
+            continue;
+        // Phase, name and arguments in the Chrome trace event format
+        const char *phase = "i";
+        std::string name, args;
+        switch(record.event)
+        {
+        case TRACE_enqueue:
+            phase = "b";
+            name = mnemonic_name(record.arg);
+            break;
+        case TRACE_complete:
+        case TRACE_lost:
+            phase = "e";
+            name = mnemonic_name(record.arg);
+            args = (record.event == TRACE_lost) ? "\"lost\":1" : "\"lost\":0";
+            break;
+        case TRACE_write:
+            name = "write";
+            args = "\"bytes\":" + std::to_string(record.arg);
+            break;
+        case TRACE_rx_first:
+            name = "rx";
+            args = "\"bytes\":" + std::to_string(record.arg);
+            break;
+        case TRACE_line:
+            name = "line";
+            args = "\"length\":" + std::to_string(record.arg);
+            break;
+        case TRACE_dispatch:
+            name = "callback " + mnemonic_name(record.arg);
+            break;
+        case TRACE_wakeup:
+            name = "wakeup " + mnemonic_name(record.arg);
+            break;
+        case TRACE_phase_begin:
+        case TRACE_phase_end:
+            phase = (record.event == TRACE_phase_begin) ? "B" : "E";
+            name = (record.arg < CYCLE_PHASES) ? phase_names[record.arg] : "phase";
+            break;
+        default:
+            continue;
+        }
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+                saved > 0 ? ",\n" : "", name.c_str(),
+                (record.event >= TRACE_phase_begin) ? "cycle" : "serial", phase,
+                record.stamp / 1000.0, getpid(), record.tid);
+        // The requests are async spans from the reply queue to the reply
+        if(phase[0] == 'b' || phase[0] == 'e')
+            fprintf(file, ",\"id\":\"0x%lx\"", (unsigned long) record.id);
+        // The instant events are shown only in their thread
+        if(phase[0] == 'i')
+            fprintf(file, ",\"s\":\"t\"");
+        if(!args.empty())
+            fprintf(file, ",\"args\":{%s}", args.c_str());
+        fprintf(file, "}");
+        ++saved;
+    }
+    fprintf(file, "\n]}\n");
+    if(fclose(file) != 0)
+        return -1;
+    return saved;
+}
+
+}
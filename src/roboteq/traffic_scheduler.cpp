@@ -0,0 +1,165 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/traffic_scheduler.h"
+
+#include <algorithm>
+
+namespace roboteq {
+
+// Bytes of a share stored when the class is idle, in seconds of bandwidth
+const double share_burst(0.05);
+// Minimum bytes stored, a line of maximum length
+const double share_min_burst(128.0);
+
+const char* priority_name(priority_t priority)
+{
+    switch(priority)
+    {
+    case PRIORITY_ESTOP: return "estop";
+    case PRIORITY_COMMAND: return "command";
+    case PRIORITY_FEEDBACK: return "feedback";
+    case PRIORITY_DIAGNOSTIC: return "diagnostic";
+    case PRIORITY_CONFIG: return "config";
+    default: return "unknown";
+    }
+}
+
+traffic_scheduler::traffic_scheduler(unsigned long baudrate)
+    : mRate(baudrate / 10.0)
+    , mBusy(false)
+    , mGranted(0)
+    , mHasGrant(false)
+    , mNext(0)
+    , mRefill(clock_t::now())
+{
+    // Default shares, the emergency stop is never limited
+    mShare[PRIORITY_ESTOP] = 1.0;
+    mShare[PRIORITY_COMMAND] = 0.4;
+    mShare[PRIORITY_FEEDBACK] = 0.3;
+    mShare[PRIORITY_DIAGNOSTIC] = 0.15;
+    mShare[PRIORITY_CONFIG] = 0.15;
+    for(size_t i = 0; i < PRIORITY_CLASSES; ++i)
+    {
+        mTokens[i] = share_min_burst;
+        mStats[i] = class_stats_t();
+    }
+}
+
+void traffic_scheduler::setShare(priority_t priority, double share)
+{
+    std::lock_guard<std::mutex> lck(mMutex);
+    mShare[priority] = std::min(std::max(share, 0.0), 1.0);
+}
+
+void traffic_scheduler::refill()
+{
+    clock_t::time_point now = clock_t::now();
+    double elapsed = std::chrono::duration<double>(now - mRefill).count();
+    mRefill = now;
+    for(size_t i = 0; i < PRIORITY_CLASSES; ++i)
+    {
+        double burst = std::max(share_min_burst, mShare[i] * mRate * share_burst);
+        mTokens[i] = std::min(burst, mTokens[i] + mShare[i] * mRate * elapsed);
+    }
+}
+
+void traffic_scheduler::grantNext()
+{
+    refill();
+    int selected = -1;
+    // The emergency stop is always first
+    if(!mQueue[PRIORITY_ESTOP].empty())
+    {
+        selected = PRIORITY_ESTOP;
+    }
+    // The highest class inside its share
+    for(size_t i = 0; selected < 0 && i < PRIORITY_CLASSES; ++i)
+    {
+        if(!mQueue[i].empty() && mTokens[i] >= mQueue[i].front().bytes)
+            selected = i;
+    }
+    // All classes over the share, the serial port is never idle
+    for(size_t i = 0; selected < 0 && i < PRIORITY_CLASSES; ++i)
+    {
+        if(!mQueue[i].empty())
+            selected = i;
+    }
+    if(selected < 0)
+        return;
+    const ticket_t &ticket = mQueue[selected].front();
+    mTokens[selected] = std::max(mTokens[selected] - ticket.bytes, -share_min_burst);
+    mGranted = ticket.id;
+    mHasGrant = true;
+    mCv.notify_all();
+}
+
+void traffic_scheduler::acquire(priority_t priority, size_t bytes)
+{
+    std::unique_lock<std::mutex> lck(mMutex);
+    clock_t::time_point start = clock_t::now();
+    ticket_t ticket = { mNext++, bytes };
+    mQueue[priority].push_back(ticket);
+    class_stats_t &stats = mStats[priority];
+    stats.depth = mQueue[priority].size();
+    stats.max_depth = std::max(stats.max_depth, stats.depth);
+    // The serial port is free and nobody is waiting the grant
+    if(!mBusy && !mHasGrant)
+    {
+        grantNext();
+    }
+    mCv.wait(lck, [this, &ticket] { return mHasGrant && mGranted == ticket.id; });
+    // Take the serial port
+    mHasGrant = false;
+    mBusy = true;
+    mQueue[priority].pop_front();
+    // Update the statistics
+    double wait = std::chrono::duration<double, std::micro>(clock_t::now() - start).count();
+    stats.depth = mQueue[priority].size();
+    stats.lines++;
+    stats.bytes += bytes;
+    stats.wait_mean += (wait - stats.wait_mean) / stats.lines;
+    stats.wait_max = std::max(stats.wait_max, wait);
+}
+
+void traffic_scheduler::release()
+{
+    std::lock_guard<std::mutex> lck(mMutex);
+    mBusy = false;
+    grantNext();
+}
+
+class_stats_t traffic_scheduler::getStats(priority_t priority)
+{
+    std::lock_guard<std::mutex> lck(mMutex);
+    return mStats[priority];
+}
+
+}
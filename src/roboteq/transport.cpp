@@ -0,0 +1,380 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "roboteq/transport.h"
+#include "roboteq/serial_port.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+namespace roboteq {
+
+// Line rate before setLineRate()
+const unsigned long default_line_rate(115200);
+// Wait of the driver over the time on the line in ms: USB latency timer of the adapters
+const int write_margin(20);
+
+fd_transport::fd_transport(int fd)
+    : mFd(-1)
+    , mEpoll(-1)
+    , mEvent(-1)
+    , mLineRate(default_line_rate)
+{
+    if(fd >= 0)
+        attach(fd);
+}
+
+fd_transport::~fd_transport()
+{
+    close();
+}
+
+bool fd_transport::open()
+{
+    // A descriptor adopted is already attached
+    return isOpen();
+}
+
+bool fd_transport::fail(const std::string &what)
+{
+    mError = what + ": " + strerror(errno);
+    close();
+    return false;
+}
+
+bool fd_transport::attach(int fd)
+{
+    mFd = fd;
+    int flags = fcntl(mFd, F_GETFL, 0);
+    if(flags < 0 || fcntl(mFd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return fail("fcntl");
+    // Wait the connection and the shutdown
+    mEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(mEvent < 0)
+        return fail("eventfd");
+    mEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if(mEpoll < 0)
+        return fail("epoll_create1");
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = mFd;
+    if(epoll_ctl(mEpoll, EPOLL_CTL_ADD, mFd, &event) < 0)
+        return fail("epoll_ctl");
+    event.data.fd = mEvent;
+    if(epoll_ctl(mEpoll, EPOLL_CTL_ADD, mEvent, &event) < 0)
+        return fail("epoll_ctl");
+    return true;
+}
+
+void fd_transport::close()
+{
+    if(mEpoll >= 0) ::close(mEpoll);
+    if(mEvent >= 0) ::close(mEvent);
+    if(mFd >= 0) ::close(mFd);
+    mEpoll = mEvent = mFd = -1;
+}
+
+long fd_transport::read(char* buffer, size_t size, int timeout)
+{
+    if(mFd < 0)
+        return -1;
+    // Read the bytes already available without wait
+    ssize_t n = ::read(mFd, buffer, size);
+    if(n > 0)
+        return n;
+    if(n == 0 && size > 0)
+    {
+        mError = "connection closed";
+        return -1;
+    }
+    if(n < 0 && errno != EAGAIN && errno != EINTR)
+    {
+        mError = std::string("read: ") + strerror(errno);
+        return -1;
+    }
+    struct epoll_event events[2];
+    int count = epoll_wait(mEpoll, events, 2, timeout);
+    if(count < 0)
+    {
+        if(errno == EINTR)
+            return 0;
+        mError = std::string("epoll_wait: ") + strerror(errno);
+        return -1;
+    }
+    for(int i = 0; i < count; ++i)
+    {
+        // Shutdown requested
+        if(events[i].data.fd == mEvent)
+        {
+            uint64_t value;
+            if(::read(mEvent, &value, sizeof(value)) < 0) {}
+            return 0;
+        }
+    }
+    if(count == 0)
+        return 0;
+    n = ::read(mFd, buffer, size);
+    if(n == 0 && size > 0)
+    {
+        mError = "connection closed";
+        return -1;
+    }
+    if(n < 0)
+    {
+        if(errno == EAGAIN || errno == EINTR)
+            return 0;
+        mError = std::string("read: ") + strerror(errno);
+        return -1;
+    }
+    return n;
+}
+
+bool fd_transport::write(const char* data, size_t size)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data);
+    iov.iov_len = size;
+    return writev(&iov, 1);
+}
+
+bool fd_transport::writev(const struct iovec* iov, int count)
+{
+    if(mFd < 0)
+        return false;
+    // Local copy to move forward on partial writes
+    struct iovec parts[16];
+    if(count > 16)
+    {
+        errno = EINVAL;
+        mError = "writev: too many buffers";
+        return false;
+    }
+    std::copy(iov, iov + count, parts);
+    struct iovec* next = parts;
+    while(count > 0)
+    {
+        ssize_t n = ::writev(mFd, next, count);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN)
+            {
+                mError = std::string("write: ") + strerror(errno);
+                return false;
+            }
+            // Output buffer full, wait the driver for the time on the line of the bytes queued and left
+            size_t left = 0;
+            for(int i = 0; i < count; ++i)
+                left += next[i].iov_len;
+            int queued = 0;
+            if(ioctl(mFd, TIOCOUTQ, &queued) < 0)
+                queued = 0;
+            int timeout = static_cast<int>((left + queued) * 10000ULL / mLineRate) + write_margin;
+            struct pollfd fd = { mFd, POLLOUT, 0 };
+            if(poll(&fd, 1, timeout) <= 0)
+            {
+                mError = "write timeout after " + std::to_string(timeout) + "ms";
+                return false;
+            }
+            continue;
+        }
+        // Skip the buffers written
+        while(count > 0 && static_cast<size_t>(n) >= next->iov_len)
+        {
+            n -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if(count > 0)
+        {
+            next->iov_base = static_cast<char*>(next->iov_base) + n;
+            next->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+void fd_transport::interrupt()
+{
+    if(mEvent >= 0)
+    {
+        uint64_t value = 1;
+        if(::write(mEvent, &value, sizeof(value)) < 0) {}
+    }
+}
+
+pty_transport::pty_transport()
+    : mSlave(-1)
+{
+}
+
+bool pty_transport::open()
+{
+    if(isOpen())
+        return true;
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if(master < 0)
+        return fail("posix_openpt");
+    if(grantpt(master) < 0 || unlockpt(master) < 0)
+    {
+        ::close(master);
+        return fail("unlockpt");
+    }
+    mSlaveName = ptsname(master);
+    // Raw slave, the emulator receive the bytes without line discipline
+    mSlave = ::open(mSlaveName.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if(mSlave < 0)
+    {
+        ::close(master);
+        return fail("open " + mSlaveName);
+    }
+    struct termios tty;
+    if(tcgetattr(mSlave, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        tcsetattr(mSlave, TCSANOW, &tty);
+    }
+    return attach(master);
+}
+
+void pty_transport::close()
+{
+    fd_transport::close();
+    if(mSlave >= 0) ::close(mSlave);
+    mSlave = -1;
+}
+
+tcp_transport::tcp_transport(const std::string &host, const std::string &port)
+    : mHost(host)
+    , mPort(port)
+{
+}
+
+bool tcp_transport::open()
+{
+    if(isOpen())
+        return true;
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int status = getaddrinfo(mHost.c_str(), mPort.c_str(), &hints, &result);
+    if(status != 0)
+    {
+        mError = "getaddrinfo " + mHost + ": " + gai_strerror(status);
+        return false;
+    }
+    int fd = -1;
+    for(struct addrinfo* it = result; it != NULL; it = it->ai_next)
+    {
+        fd = socket(it->ai_family, it->ai_socktype | SOCK_CLOEXEC, it->ai_protocol);
+        if(fd < 0)
+            continue;
+        if(connect(fd, it->ai_addr, it->ai_addrlen) == 0)
+            break;
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if(fd < 0)
+        return fail("connect " + mHost + ":" + mPort);
+    // Every line is sent immediately
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    return attach(fd);
+}
+
+loopback_transport::loopback_transport()
+    : mPeer(-1)
+{
+}
+
+loopback_transport::~loopback_transport()
+{
+    if(mPeer >= 0) ::close(mPeer);
+}
+
+bool loopback_transport::open()
+{
+    // The peer could be already taken
+    if(isOpen())
+        return true;
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+        return fail("socketpair");
+    mPeer = sv[1];
+    return attach(sv[0]);
+}
+
+fd_transport* loopback_transport::takePeer()
+{
+    if(mPeer < 0)
+        return NULL;
+    fd_transport* peer = new fd_transport(mPeer);
+    mPeer = -1;
+    return peer;
+}
+
+transport* make_transport(const std::string &address, unsigned long baudrate)
+{
+    if(address.compare(0, 6, "tcp://") == 0)
+    {
+        std::string gateway = address.substr(6);
+        size_t sep = gateway.rfind(':');
+        if(sep == std::string::npos)
+            return new tcp_transport(gateway, "2000");
+        return new tcp_transport(gateway.substr(0, sep), gateway.substr(sep + 1));
+    }
+    if(address.compare(0, 6, "pty://") == 0)
+    {
+        return new pty_transport();
+    }
+    if(address.compare(0, 11, "loopback://") == 0)
+    {
+        return new loopback_transport();
+    }
+    return new serial_port(address, baudrate);
+}
+
+}
@@ -35,6 +35,7 @@
 
 #include "roboteq/serial_controller.h"
 #include "roboteq/roboteq.h"
+#include "roboteq/control_executor.h"
 
 #include <boost/chrono.hpp>
 
@@ -46,11 +47,13 @@ ros::Timer control_loop;
 ros::Timer diagnostic_loop;
 
 roboteq::serial_controller *rSerial;
+roboteq::ControlExecutor *rExecutor = NULL;
 
 // >>>>> Ctrl+C handler
 void siginthandler(int param)
 {
     ROS_INFO("User pressed Ctrl+C Shutting down...");
+    // The control thread is stopped in main after ros::spin(), a join is not safe in a signal handler
     control_loop.stop();
     diagnostic_loop.stop();
     rSerial->stop();
@@ -75,9 +78,14 @@ void controlLoop(roboteq::Roboteq &roboteq,
     last_time = this_time;
 
     //ROS_INFO_STREAM("CONTROL - running");
-    // Process control loop
+    // Process control loop, read and write time their own phases
+    roboteq::phase_profiler &profiler = roboteq.getProfiler();
+    roboteq::phase_timer cycle_timer(profiler, roboteq::PHASE_CYCLE);
     roboteq.read(ros::Time::now(), elapsed);
-    cm.update(ros::Time::now(), elapsed);
+    {
+        roboteq::phase_timer update_timer(profiler, roboteq::PHASE_UPDATE);
+        cm.update(ros::Time::now(), elapsed);
+    }
     roboteq.write(ros::Time::now(), elapsed);
 }
 
@@ -103,6 +111,14 @@ int main(int argc, char **argv) {
     private_nh.param<double>("control_frequency", control_frequency, 1.0);
     private_nh.param<double>("diagnostic_frequency", diagnostic_frequency, 1.0);
     ROS_INFO_STREAM("Control:" << control_frequency << "Hz - Diagnostic:" << diagnostic_frequency << "Hz");
+    // Dedicated realtime control thread
+    bool realtime;
+    roboteq::executor_config_t executor_config;
+    private_nh.param<bool>("realtime/enable", realtime, false);
+    private_nh.param<int>("realtime/priority", executor_config.priority, 0);
+    private_nh.param<int>("realtime/cpu", executor_config.cpu, -1);
+    private_nh.param<bool>("realtime/lock_memory", executor_config.lock_memory, false);
+    executor_config.period = 1 / control_frequency;
 
     string serial_port_string;
     int32_t baud_rate;
@@ -112,6 +128,13 @@ int main(int argc, char **argv) {
     ROS_INFO_STREAM("Open Serial " << serial_port_string << ":" << baud_rate);
 
     rSerial = new roboteq::serial_controller(serial_port_string, baud_rate);
+    // Capture of all bytes exchanged with the board, size in MB
+    string capture_file;
+    int capture_size;
+    private_nh.param<string>("capture/file", capture_file, "");
+    private_nh.param<int>("capture/size", capture_size, 16);
+    if(!capture_file.empty())
+        rSerial->startCapture(capture_file, static_cast<size_t>(capture_size) << 20);
     // Run the serial controller
     bool start = rSerial->start();
     // Check connection started
@@ -127,18 +150,30 @@ int main(int argc, char **argv) {
 
         // Setup separate queue and single-threaded spinner to process timer callbacks
         // that interface with RoboTeq hardware.
-        // This avoids having to lock around hardware access, but precludes realtime safety
-        // in the control loop.
+        // With realtime/enable the control loop runs in the ControlExecutor thread instead,
+        // concurrent with the diagnostics of this spinner: the diagnostics read only the seqlock snapshots
+        // and the atomic counters of the control loop, a control cycle never waits the diagnostics.
         ros::CallbackQueue unav_queue;
         ros::AsyncSpinner unav_spinner(1, &unav_queue);
 
         time_source::time_point last_time = time_source::now();
-        ros::TimerOptions control_timer(
-                    ros::Duration(1 / control_frequency),
-                    boost::bind(controlLoop, boost::ref(interface), boost::ref(cm), boost::ref(last_time)),
-                    &unav_queue);
-        // Global variable
-        control_loop = nh.createTimer(control_timer);
+        if(realtime)
+        {
+            // Control loop with absolute deadlines in a dedicated thread
+            rExecutor = new roboteq::ControlExecutor(executor_config,
+                                                     [&interface, &cm, &last_time]() { controlLoop(interface, cm, last_time); });
+            interface.addDiagnostic(*rExecutor);
+            rExecutor->start();
+        }
+        else
+        {
+            ros::TimerOptions control_timer(
+                        ros::Duration(1 / control_frequency),
+                        boost::bind(controlLoop, boost::ref(interface), boost::ref(cm), boost::ref(last_time)),
+                        &unav_queue);
+            // Global variable
+            control_loop = nh.createTimer(control_timer);
+        }
 
         ros::TimerOptions diagnostic_timer(
                     ros::Duration(1 / diagnostic_frequency),
@@ -153,6 +188,14 @@ int main(int argc, char **argv) {
 
         // Process remainder of ROS callbacks separately, mainly ControlManager related
         ros::spin();
+        // Stop the loops before the interface and the controller manager go out of scope
+        unav_spinner.stop();
+        if(rExecutor != NULL)
+        {
+            rExecutor->stop();
+            delete rExecutor;
+            rExecutor = NULL;
+        }
     } else {
 
         ROS_ERROR_STREAM("Error connection, shutting down");
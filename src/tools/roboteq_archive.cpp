@@ -0,0 +1,405 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Offline queries on the telemetry archive of the driver. The chunks out of
+ * the time range are skipped from their header, the aggregates use the range
+ * stored in the header of the chunks inside the time range and decode only
+ * the columns required for the others. The stall events are counted on the
+ * runs of the flags, without expand them.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "roboteq/telemetry_archive.h"
+#include "roboteq/flight_recorder.h"
+
+using namespace roboteq;
+
+// Motor stalled in the flags FM [pag. 246]
+const int64_t flag_stalled = 0x02;
+
+typedef struct _query {
+    // Wall time range in us
+    int64_t from;
+    int64_t to;
+    // Channel from 1, zero all channels
+    int channel;
+} query_t;
+
+typedef struct _channel_stats {
+    uint64_t rows;
+    int64_t first;
+    int64_t last;
+    int32_t min[TELEMETRY_FIELDS];
+    int32_t max[TELEMETRY_FIELDS];
+    // Rising edges of the stall flag and rows with the flag
+    uint64_t stalls;
+    uint64_t stalled;
+    bool was_stalled;
+} channel_stats_t;
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s command [options]\n"
+                    "  info file                 Chunks, rows and compression of the archive\n"
+                    "  extract file [range]      Rows in CSV\n"
+                    "  stats file [range]        Peak currents, voltage range and stall events of each channel\n"
+                    "  import flight archive     Append the frames of a flight file to an archive\n"
+                    "Range:\n"
+                    "  --from time               Seconds from the epoch or \"YYYY-mm-dd HH:MM:SS\"\n"
+                    "  --to time\n"
+                    "  --channel N               Only the channel N, from 1\n", name);
+}
+
+/**
+ * @brief parse_time Parse a wall time
+ * @param text Seconds from the epoch or local time "YYYY-mm-dd HH:MM:SS"
+ * @param us The time in us
+ * @return false if the format is unknown
+ */
+static bool parse_time(const char* text, int64_t &us)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(text, "%Y-%m-%d %H:%M:%S", &tm);
+    if(end != NULL && *end == '\0')
+    {
+        tm.tm_isdst = -1;
+        us = static_cast<int64_t>(mktime(&tm)) * 1000000LL;
+        return true;
+    }
+    char* rest;
+    double seconds = strtod(text, &rest);
+    if(rest == text || *rest != '\0')
+        return false;
+    us = static_cast<int64_t>(seconds * 1e6);
+    return true;
+}
+
+static std::string format_time(int64_t us)
+{
+    time_t seconds = us / 1000000LL;
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    char millis[8];
+    snprintf(millis, sizeof(millis), ".%03d", static_cast<int>(us / 1000 % 1000));
+    return std::string(stamp) + millis;
+}
+
+static bool selected(const archive_chunk_t *chunk, const query_t &query)
+{
+    if(query.channel > 0 && chunk->channel + 1 != query.channel)
+        return false;
+    return chunk->last >= query.from && chunk->first <= query.to;
+}
+
+static int info(archive_reader &reader)
+{
+    uint64_t chunks = 0, rows = 0;
+    uint64_t column_bytes[ARCHIVE_COLUMNS] = {0};
+    int64_t first = INT64_MAX, last = INT64_MIN;
+    const archive_chunk_t *chunk;
+    while((chunk = reader.next()) != NULL)
+    {
+        ++chunks;
+        rows += chunk->rows;
+        first = std::min(first, chunk->first);
+        last = std::max(last, chunk->last);
+        for(size_t c = 0; c < ARCHIVE_COLUMNS; ++c)
+            column_bytes[c] += chunk->column[c].size;
+    }
+    printf("Size:   %lu bytes\n", (unsigned long) reader.size());
+    printf("Chunks: %lu\n", (unsigned long) chunks);
+    printf("Rows:   %lu\n", (unsigned long) rows);
+    if(rows == 0)
+        return 0;
+    printf("From:   %s\nTo:     %s\n", format_time(first).c_str(), format_time(last).c_str());
+    // A flight record is 64 bytes for each row
+    printf("Bytes/row: %.2f (raw %lu)\n", reader.size() / (double) rows, (unsigned long) sizeof(flight_record_t));
+    printf("Bits/row of each column:\n  time %.1f  valid %.1f", column_bytes[COLUMN_TIME] * 8.0 / rows,
+           column_bytes[COLUMN_VALID] * 8.0 / rows);
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        printf("  %s %.1f", telemetry_query[n][0], column_bytes[COLUMN_FIELDS + n] * 8.0 / rows);
+    printf("\n");
+    return 0;
+}
+
+static int extract(archive_reader &reader, const query_t &query)
+{
+    printf("time,channel");
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        printf(",%s", telemetry_query[n][0]);
+    printf("\n");
+    std::vector<int64_t> columns[ARCHIVE_COLUMNS];
+    const archive_chunk_t *chunk;
+    while((chunk = reader.next()) != NULL)
+    {
+        if(!selected(chunk, query))
+            continue;
+        bool status = true;
+        for(size_t c = 0; c < ARCHIVE_COLUMNS; ++c)
+            status &= reader.decode(chunk, (archive_column_id_t) c, columns[c]);
+        if(!status)
+        {
+            fprintf(stderr, "Chunk corrupted at %s\n", format_time(chunk->first).c_str());
+            continue;
+        }
+        for(size_t row = 0; row < chunk->rows; ++row)
+        {
+            int64_t time = columns[COLUMN_TIME][row];
+            if(time < query.from || time > query.to)
+                continue;
+            printf("%s,%u", format_time(time).c_str(), chunk->channel + 1);
+            for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+            {
+                if(columns[COLUMN_VALID][row] & (1 << n))
+                    printf(",%ld", (long) columns[COLUMN_FIELDS + n][row]);
+                else
+                    printf(",");
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief count_stalls Count the rising edges of the stall flag on the runs of the flags
+ */
+static void count_stalls(const std::vector<archive_run_t> &runs, channel_stats_t &stats)
+{
+    for(size_t i = 0; i < runs.size(); ++i)
+    {
+        bool stalled = (runs[i].value & flag_stalled) != 0;
+        if(stalled && !stats.was_stalled)
+            stats.stalls++;
+        if(stalled)
+            stats.stalled += runs[i].length;
+        stats.was_stalled = stalled;
+    }
+}
+
+static int stats(archive_reader &reader, const query_t &query)
+{
+    channel_stats_t channels[max_channels];
+    for(size_t i = 0; i < max_channels; ++i)
+    {
+        memset(&channels[i], 0, sizeof(channel_stats_t));
+        channels[i].first = INT64_MAX;
+        channels[i].last = INT64_MIN;
+        std::fill(channels[i].min, channels[i].min + TELEMETRY_FIELDS, INT32_MAX);
+        std::fill(channels[i].max, channels[i].max + TELEMETRY_FIELDS, INT32_MIN);
+    }
+    uint64_t skipped = 0, summary = 0, decoded = 0;
+    std::vector<int64_t> time, valid, values;
+    std::vector<archive_run_t> runs;
+    const archive_chunk_t *chunk;
+    while((chunk = reader.next()) != NULL)
+    {
+        if(!selected(chunk, query) || chunk->channel >= max_channels)
+        {
+            ++skipped;
+            continue;
+        }
+        channel_stats_t &stat = channels[chunk->channel];
+        if(chunk->first >= query.from && chunk->last <= query.to)
+        {
+            // All rows in the range, the header has the range of each field
+            ++summary;
+            stat.rows += chunk->rows;
+            stat.first = std::min(stat.first, chunk->first);
+            stat.last = std::max(stat.last, chunk->last);
+            for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+            {
+                stat.min[n] = std::min(stat.min[n], chunk->min[n]);
+                stat.max[n] = std::max(stat.max[n], chunk->max[n]);
+            }
+            if(reader.runs(chunk, (archive_column_id_t) (COLUMN_FIELDS + FIELD_FLAGS), runs))
+                count_stalls(runs, stat);
+            continue;
+        }
+        // The border of the range, decode the rows
+        ++decoded;
+        if(!reader.decode(chunk, COLUMN_TIME, time) || !reader.decode(chunk, COLUMN_VALID, valid))
+            continue;
+        size_t begin = std::lower_bound(time.begin(), time.end(), query.from) - time.begin();
+        size_t end = std::upper_bound(time.begin(), time.end(), query.to) - time.begin();
+        if(begin >= end)
+            continue;
+        stat.rows += end - begin;
+        stat.first = std::min(stat.first, time[begin]);
+        stat.last = std::max(stat.last, time[end - 1]);
+        for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        {
+            if(!reader.decode(chunk, (archive_column_id_t) (COLUMN_FIELDS + n), values))
+                continue;
+            for(size_t row = begin; row < end; ++row)
+            {
+                if(!(valid[row] & (1 << n)))
+                    continue;
+                stat.min[n] = std::min<int64_t>(stat.min[n], values[row]);
+                stat.max[n] = std::max<int64_t>(stat.max[n], values[row]);
+            }
+            if(n == FIELD_FLAGS)
+            {
+                // Runs of the rows in the range
+                runs.clear();
+                for(size_t row = begin; row < end; ++row)
+                {
+                    if(runs.empty() || runs.back().value != values[row])
+                        runs.push_back(archive_run_t{values[row], 0});
+                    runs.back().length++;
+                }
+                count_stalls(runs, stat);
+            }
+        }
+    }
+    printf("channel     rows  duration(s)  peak A  peak BA   min V   max V  stalls  stalled(s)\n");
+    for(size_t i = 0; i < max_channels; ++i)
+    {
+        const channel_stats_t &stat = channels[i];
+        if(stat.rows == 0)
+            continue;
+        double duration = (stat.last - stat.first) / 1e6;
+        // Amps and volts in tenths [pag. 230, 262]
+        double peak = std::max(std::abs(stat.max[FIELD_AMPS]), std::abs(stat.min[FIELD_AMPS])) / 10.0;
+        double peak_battery = std::max(std::abs(stat.max[FIELD_BATTERY_AMPS]), std::abs(stat.min[FIELD_BATTERY_AMPS])) / 10.0;
+        // Time stalled estimated from the mean period of the rows
+        double stalled = (stat.rows > 1) ? stat.stalled * duration / (stat.rows - 1) : 0;
+        printf("%7lu %8lu %12.1f %7.1f %8.1f %7.1f %7.1f %7lu %11.1f\n", (unsigned long) i + 1, (unsigned long) stat.rows,
+               duration, peak, peak_battery, stat.min[FIELD_VOLTS] / 10.0, stat.max[FIELD_VOLTS] / 10.0,
+               (unsigned long) stat.stalls, stalled);
+    }
+    printf("Chunks skipped %lu, from the header %lu, decoded %lu\n", (unsigned long) skipped,
+           (unsigned long) summary, (unsigned long) decoded);
+    return 0;
+}
+
+static int import(const std::string &flight, const std::string &archive)
+{
+    flight_reader reader;
+    if(!reader.open(flight))
+    {
+        fprintf(stderr, "%s\n", reader.error().c_str());
+        return 1;
+    }
+    archive_writer writer;
+    if(!writer.start(archive))
+    {
+        fprintf(stderr, "%s\n", writer.error().c_str());
+        return 1;
+    }
+    writer.setWallOffset(reader.header().wall_offset);
+    flight_record_t record;
+    motor_frame_t frame;
+    uint64_t rows = 0;
+    while(reader.next(record))
+    {
+        if(record.channel >= max_channels)
+            continue;
+        frame.valid = record.valid;
+        for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        {
+            frame.value[n] = record.value[n];
+            frame.stamp[n] = record.stamp;
+        }
+        writer.append(record.channel, frame);
+        // Never drop a block, the writer is slower than the reader
+        if(++rows % archive_rows == 0)
+            writer.sync();
+    }
+    writer.stop();
+    printf("Imported %lu rows, dropped %lu\n", (unsigned long) rows, (unsigned long) writer.dropped());
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string command(argv[1]);
+    if(command == "import")
+    {
+        if(argc != 4)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        return import(argv[2], argv[3]);
+    }
+    query_t query;
+    query.from = INT64_MIN;
+    query.to = INT64_MAX;
+    query.channel = 0;
+    for(int i = 3; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if(i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        bool status = true;
+        if(arg == "--from") status = parse_time(value, query.from);
+        else if(arg == "--to") status = parse_time(value, query.to);
+        else if(arg == "--channel") query.channel = atoi(value);
+        else status = false;
+        if(!status)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    archive_reader reader;
+    if(!reader.open(argv[2]))
+    {
+        fprintf(stderr, "%s\n", reader.error().c_str());
+        return 1;
+    }
+    if(command == "info") return info(reader);
+    if(command == "extract") return extract(reader, query);
+    if(command == "stats") return stats(reader, query);
+    usage(argv[0]);
+    return 1;
+}
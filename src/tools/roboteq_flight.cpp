@@ -0,0 +1,129 @@
+/**
+ * Copyright (C) 2017, Raffaello Bonghi <raffaello@rnext.it>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived 
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, 
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS 
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Dump of the flight file of the driver in CSV, one line for each frame of a
+ * channel from the oldest. The raw values are in the units of the board, the
+ * fields not decoded in a frame are empty.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include "roboteq/flight_recorder.h"
+
+using namespace roboteq;
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [options] file\n"
+                    "  --last s          Only the last seconds of the file\n"
+                    "  --channel N       Only the channel N, from 1\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    std::string path;
+    double last = 0;
+    int channel = 0;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if(arg.compare(0, 2, "--") != 0)
+        {
+            path = arg;
+            continue;
+        }
+        if(i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        if(arg == "--last") last = atof(value);
+        else if(arg == "--channel") channel = atoi(value);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(path.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    flight_reader reader;
+    if(!reader.open(path))
+    {
+        fprintf(stderr, "%s\n", reader.error().c_str());
+        return 1;
+    }
+    // The newest stamp for --last
+    flight_record_t record;
+    uint64_t newest = 0;
+    if(last > 0)
+    {
+        while(reader.next(record))
+            newest = std::max(newest, record.stamp);
+        reader.rewind();
+    }
+    uint64_t from = (last > 0 && newest > last * 1e9) ? newest - static_cast<uint64_t>(last * 1e9) : 0;
+    printf("time,channel");
+    for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        printf(",%s", telemetry_query[n][0]);
+    printf("\n");
+    while(reader.next(record))
+    {
+        if(record.stamp < from || (channel > 0 && record.channel + 1 != channel))
+            continue;
+        // Wall time with the milliseconds
+        int64_t wall = reader.wall(record.stamp);
+        time_t seconds = wall / 1000000000LL;
+        struct tm tm;
+        localtime_r(&seconds, &tm);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        printf("%s.%03d,%u", stamp, static_cast<int>(wall / 1000000LL % 1000), record.channel + 1);
+        for(size_t n = 0; n < TELEMETRY_FIELDS; ++n)
+        {
+            if(record.valid & (1 << n))
+                printf(",%d", record.value[n]);
+            else
+                printf(",");
+        }
+        printf("\n");
+    }
+    return 0;
+}